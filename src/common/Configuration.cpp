@@ -19,6 +19,7 @@
 
 #include "Configuration.h"
 
+#include <QHash>
 #include <QSettings>
 
 namespace SDDM {
@@ -33,6 +34,26 @@ namespace SDDM {
         QString defaultPath { "" };
 
         QString serverPath { "" };
+        QString displayServer { "" };
+        QHash<QString, QString> seatDisplayServers;
+        bool reuseDisplayServer { true };
+        int displayFailureLimit { 5 };
+        bool preserveSessions { false };
+        bool readahead { true };
+
+        QString displayServerLog { "none" };
+        QString greeterLog { "journal" };
+        QString sessionLog { "file" };
+        int logSizeLimit { 1024 };
+        bool userRuntimeFiles { false };
+
+        ProcessPolicy displayServerPolicy;
+        ProcessPolicy greeterPolicy;
+        ProcessPolicy sessionPolicy;
+
+        QString virtualServerPath { "/usr/bin/Xvfb" };
+        int virtualDisplayLimit { 0 };
+        int virtualDisplayIdleTimeout { 600 };
 
         QString xauthPath { "" };
 
@@ -50,6 +71,9 @@ namespace SDDM {
 
         QString themesDir { "" };
         QString currentTheme { "" };
+        QString fallbackTheme { "" };
+        bool greeterZygote { false };
+        int greeterIdleTimeout { 300 };
 
         int minimumUid { 0 };
         int maximumUid { 65000 };
@@ -86,6 +110,46 @@ namespace SDDM {
         }
     }
 
+    ProcessPolicy readPolicy(QSettings &settings, const QString &group) {
+        ProcessPolicy policy;
+
+        settings.beginGroup(group);
+
+        // empty values keep what the daemon has
+        QString nice = settings.value("Nice", "").toString();
+        policy.hasNice = !nice.isEmpty();
+        policy.nice = nice.toInt();
+        policy.schedPolicy = settings.value("SchedPolicy", "").toString().toLower();
+        policy.schedPriority = settings.value("SchedPriority", policy.schedPriority).toInt();
+        policy.ioSchedClass = settings.value("IOSchedClass", "").toString().toLower();
+        policy.ioPriority = settings.value("IOPriority", policy.ioPriority).toInt();
+        QString oomScoreAdjust = settings.value("OOMScoreAdjust", "").toString();
+        policy.hasOomScoreAdjust = !oomScoreAdjust.isEmpty();
+        policy.oomScoreAdjust = oomScoreAdjust.toInt();
+        for (const QString &cpu: settings.value("CPUAffinity", "").toString().split(' ', QString::SkipEmptyParts))
+            policy.cpuAffinity << cpu.toInt();
+
+        settings.endGroup();
+
+        return policy;
+    }
+
+    void writePolicy(QSettings &settings, const QString &group, const ProcessPolicy &policy) {
+        QStringList cpuAffinity;
+        for (int cpu: policy.cpuAffinity)
+            cpuAffinity << QString::number(cpu);
+
+        settings.beginGroup(group);
+        settings.setValue("Nice", policy.hasNice ? QString::number(policy.nice) : QString(""));
+        settings.setValue("SchedPolicy", policy.schedPolicy);
+        settings.setValue("SchedPriority", policy.schedPriority);
+        settings.setValue("IOSchedClass", policy.ioSchedClass);
+        settings.setValue("IOPriority", policy.ioPriority);
+        settings.setValue("OOMScoreAdjust", policy.hasOomScoreAdjust ? QString::number(policy.oomScoreAdjust) : QString(""));
+        settings.setValue("CPUAffinity", cpuAffinity.join(" "));
+        settings.endGroup();
+    }
+
     void Configuration::load() {
         // create settings object
         QSettings settings(d->configPath, QSettings::IniFormat);
@@ -93,6 +157,27 @@ namespace SDDM {
         d->cursorTheme = settings.value("CursorTheme", "").toString();
         d->defaultPath = settings.value("DefaultPath", "").toString();
         d->serverPath = settings.value("ServerPath", "").toString();
+        d->displayServer = settings.value("DisplayServer", "").toString().toLower();
+        d->seatDisplayServers.clear();
+        for (const QString &group: settings.childGroups()) {
+            if (group.startsWith("seat") && settings.contains(group + "/DisplayServer"))
+                d->seatDisplayServers[group] = settings.value(group + "/DisplayServer").toString().toLower();
+        }
+        d->reuseDisplayServer = settings.value("ReuseDisplayServer", d->reuseDisplayServer).toBool();
+        d->displayFailureLimit = settings.value("DisplayFailureLimit", d->displayFailureLimit).toInt();
+        d->preserveSessions = settings.value("PreserveSessions", d->preserveSessions).toBool();
+        d->readahead = settings.value("Readahead", d->readahead).toBool();
+        d->displayServerLog = settings.value("DisplayServerLog", d->displayServerLog).toString().toLower();
+        d->greeterLog = settings.value("GreeterLog", d->greeterLog).toString().toLower();
+        d->sessionLog = settings.value("SessionLog", d->sessionLog).toString().toLower();
+        d->logSizeLimit = settings.value("LogSizeLimit", d->logSizeLimit).toInt();
+        d->userRuntimeFiles = settings.value("UserRuntimeFiles", d->userRuntimeFiles).toBool();
+        d->displayServerPolicy = readPolicy(settings, "DisplayServerPolicy");
+        d->greeterPolicy = readPolicy(settings, "GreeterPolicy");
+        d->sessionPolicy = readPolicy(settings, "SessionPolicy");
+        d->virtualServerPath = settings.value("VirtualServerPath", d->virtualServerPath).toString();
+        d->virtualDisplayLimit = settings.value("VirtualDisplayLimit", d->virtualDisplayLimit).toInt();
+        d->virtualDisplayIdleTimeout = settings.value("VirtualDisplayIdleTimeout", d->virtualDisplayIdleTimeout).toInt();
         d->xauthPath = settings.value("XauthPath", "").toString();
         d->authDir = appendSlash(settings.value("AuthDir", "").toString());
         d->haltCommand = settings.value("HaltCommand", "").toString();
@@ -104,6 +189,9 @@ namespace SDDM {
         d->facesDir = appendSlash(settings.value("FacesDir", "").toString());
         d->themesDir = appendSlash(settings.value("ThemesDir", "").toString());
         d->currentTheme = settings.value("CurrentTheme", "").toString();
+        d->fallbackTheme = settings.value("FallbackTheme", "").toString();
+        d->greeterZygote = settings.value("GreeterZygote", d->greeterZygote).toBool();
+        d->greeterIdleTimeout = settings.value("GreeterIdleTimeout", d->greeterIdleTimeout).toInt();
         d->minimumUid = settings.value("MinimumUid", "0").toInt();
         d->maximumUid = settings.value("MaximumUid", "65000").toInt();
         d->hideUsers = settings.value("HideUsers", "").toString().split(' ', QString::SkipEmptyParts);
@@ -131,6 +219,24 @@ namespace SDDM {
         settings.setValue("CursorTheme", d->cursorTheme);
         settings.setValue("DefaultPath", d->defaultPath);
         settings.setValue("ServerPath", d->serverPath);
+        settings.setValue("DisplayServer", d->displayServer);
+        for (const QString &seat: d->seatDisplayServers.keys())
+            settings.setValue(seat + "/DisplayServer", d->seatDisplayServers[seat]);
+        settings.setValue("ReuseDisplayServer", d->reuseDisplayServer);
+        settings.setValue("DisplayFailureLimit", d->displayFailureLimit);
+        settings.setValue("PreserveSessions", d->preserveSessions);
+        settings.setValue("Readahead", d->readahead);
+        settings.setValue("DisplayServerLog", d->displayServerLog);
+        settings.setValue("GreeterLog", d->greeterLog);
+        settings.setValue("SessionLog", d->sessionLog);
+        settings.setValue("LogSizeLimit", d->logSizeLimit);
+        settings.setValue("UserRuntimeFiles", d->userRuntimeFiles);
+        writePolicy(settings, "DisplayServerPolicy", d->displayServerPolicy);
+        writePolicy(settings, "GreeterPolicy", d->greeterPolicy);
+        writePolicy(settings, "SessionPolicy", d->sessionPolicy);
+        settings.setValue("VirtualServerPath", d->virtualServerPath);
+        settings.setValue("VirtualDisplayLimit", d->virtualDisplayLimit);
+        settings.setValue("VirtualDisplayIdleTimeout", d->virtualDisplayIdleTimeout);
         settings.setValue("XauthPath", d->xauthPath);
         settings.setValue("AuthDir", d->authDir);
         settings.setValue("HaltCommand", d->haltCommand);
@@ -142,6 +248,9 @@ namespace SDDM {
         settings.setValue("FacesDir", d->facesDir);
         settings.setValue("ThemesDir", d->themesDir);
         settings.setValue("CurrentTheme", d->currentTheme);
+        settings.setValue("FallbackTheme", d->fallbackTheme);
+        settings.setValue("GreeterZygote", d->greeterZygote);
+        settings.setValue("GreeterIdleTimeout", d->greeterIdleTimeout);
         settings.setValue("MinimumUid", d->minimumUid);
         settings.setValue("MaximumUid", d->maximumUid);
         settings.setValue("HideUsers", d->hideUsers.join(" "));
@@ -176,6 +285,70 @@ namespace SDDM {
         return d->serverPath;
     }
 
+    QString Configuration::displayServer(const QString &seat) const {
+        return d->seatDisplayServers.value(seat, d->displayServer);
+    }
+
+    bool Configuration::reuseDisplayServer() const {
+        return d->reuseDisplayServer;
+    }
+
+    const int Configuration::displayFailureLimit() const {
+        return d->displayFailureLimit;
+    }
+
+    bool Configuration::preserveSessions() const {
+        return d->preserveSessions;
+    }
+
+    bool Configuration::readahead() const {
+        return d->readahead;
+    }
+
+    const QString &Configuration::displayServerLog() const {
+        return d->displayServerLog;
+    }
+
+    const QString &Configuration::greeterLog() const {
+        return d->greeterLog;
+    }
+
+    const QString &Configuration::sessionLog() const {
+        return d->sessionLog;
+    }
+
+    const int Configuration::logSizeLimit() const {
+        return d->logSizeLimit;
+    }
+
+    bool Configuration::userRuntimeFiles() const {
+        return d->userRuntimeFiles;
+    }
+
+    const ProcessPolicy &Configuration::displayServerPolicy() const {
+        return d->displayServerPolicy;
+    }
+
+    const ProcessPolicy &Configuration::greeterPolicy() const {
+        return d->greeterPolicy;
+    }
+
+    const ProcessPolicy &Configuration::sessionPolicy() const {
+        return d->sessionPolicy;
+    }
+
+    const QString &Configuration::virtualServerPath() const {
+        return d->virtualServerPath;
+    }
+
+    const int Configuration::virtualDisplayLimit() const {
+        return d->virtualDisplayLimit;
+    }
+
+    const int Configuration::virtualDisplayIdleTimeout() const {
+        return d->virtualDisplayIdleTimeout;
+    }
+
     const QString &Configuration::xauthPath() const {
         return d->xauthPath;
     }
@@ -221,6 +394,18 @@ namespace SDDM {
         return d->currentTheme;
     }
 
+    const QString &Configuration::fallbackTheme() const {
+        return d->fallbackTheme;
+    }
+
+    bool Configuration::greeterZygote() const {
+        return d->greeterZygote;
+    }
+
+    const int Configuration::greeterIdleTimeout() const {
+        return d->greeterIdleTimeout;
+    }
+
     QString Configuration::currentThemePath() const {
         return d->themesDir + d->currentTheme;
     }
@@ -20,6 +20,7 @@
 #ifndef SDDM_CONFIGURATION_H
 #define SDDM_CONFIGURATION_H
 
+#include <QList>
 #include <QObject>
 #include <QString>
 #include <QStringList>
@@ -27,6 +28,19 @@
 namespace SDDM {
     class ConfigurationPrivate;
 
+    class ProcessPolicy {
+    public:
+        bool hasNice { false };
+        int nice { 0 };
+        QString schedPolicy { "" };
+        int schedPriority { 0 };
+        QString ioSchedClass { "" };
+        int ioPriority { 4 };
+        bool hasOomScoreAdjust { false };
+        int oomScoreAdjust { 0 };
+        QList<int> cpuAffinity;
+    };
+
     class Configuration : public QObject {
         Q_OBJECT
         Q_DISABLE_COPY(Configuration)
@@ -44,6 +58,25 @@ namespace SDDM {
         const QString &defaultPath() const;
 
         const QString &serverPath() const;
+        QString displayServer(const QString &seat) const;
+        bool reuseDisplayServer() const;
+        const int displayFailureLimit() const;
+        bool preserveSessions() const;
+        bool readahead() const;
+
+        const QString &displayServerLog() const;
+        const QString &greeterLog() const;
+        const QString &sessionLog() const;
+        const int logSizeLimit() const;
+        bool userRuntimeFiles() const;
+
+        const ProcessPolicy &displayServerPolicy() const;
+        const ProcessPolicy &greeterPolicy() const;
+        const ProcessPolicy &sessionPolicy() const;
+
+        const QString &virtualServerPath() const;
+        const int virtualDisplayLimit() const;
+        const int virtualDisplayIdleTimeout() const;
 
         const QString &xauthPath() const;
 
@@ -63,7 +96,10 @@ namespace SDDM {
 
         const QString &themesDir() const;
         const QString &currentTheme() const;
+        const QString &fallbackTheme() const;
         QString currentThemePath() const;
+        bool greeterZygote() const;
+        const int greeterIdleTimeout() const;
 
         const int minimumUid() const;
         const int maximumUid() const;
@@ -30,14 +30,17 @@ namespace SDDM {
         Reboot,
         Suspend,
         Hibernate,
-        HybridSleep
+        HybridSleep,
+        Ready
     };
 
     enum class DaemonMessages {
         HostName,
         Capabilities,
         LoginSucceeded,
-        LoginFailed
+        LoginFailed,
+        PowerActionSucceeded,
+        PowerActionFailed
     };
 
     enum Capability {
@@ -0,0 +1,127 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+
+#include "AdoptedProcess.h"
+
+#include <QFile>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <QTimer>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <sys/syscall.h>
+
+#define POLL_INTERVAL 1000
+
+namespace SDDM {
+    AdoptedProcess::AdoptedProcess(qint64 pid, QObject *parent) : QObject(parent), m_pid(pid) {
+        // remember the process, pids get reused
+        m_startTime = startTime(pid);
+        m_running = (m_startTime != 0);
+
+        // check flag
+        if (!m_running)
+            return;
+
+#ifdef SYS_pidfd_open
+        // the process is not our child, get notified when it exits
+        m_fd = syscall(SYS_pidfd_open, pid, 0);
+#endif
+        if (m_fd != -1) {
+            m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+            connect(m_notifier, SIGNAL(activated(int)), this, SLOT(check()));
+        } else {
+            // older kernels, poll instead
+            m_timer = new QTimer(this);
+            connect(m_timer, SIGNAL(timeout()), this, SLOT(check()));
+            m_timer->start(POLL_INTERVAL);
+        }
+    }
+
+    AdoptedProcess::~AdoptedProcess() {
+        if (m_fd != -1)
+            close(m_fd);
+    }
+
+    qint64 AdoptedProcess::pid() const {
+        return m_pid;
+    }
+
+    bool AdoptedProcess::isRunning() const {
+        return m_running;
+    }
+
+    qulonglong AdoptedProcess::startTime(qint64 pid) {
+        QFile file(QString("/proc/%1/stat").arg(pid));
+
+        // open file
+        if (!file.open(QIODevice::ReadOnly))
+            return 0;
+
+        // the command name may contain spaces, fields are counted after it
+        QByteArray stat = file.readAll();
+        QList<QByteArray> fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+
+        // zombies are not running anymore
+        if (fields.value(0) == "Z")
+            return 0;
+
+        // start time is field 22, the 20th after the command name
+        return fields.value(19).toULongLong();
+    }
+
+    bool AdoptedProcess::isRunning(qint64 pid, qulonglong startTime) {
+        return (pid > 0) && (startTime != 0) && (AdoptedProcess::startTime(pid) == startTime);
+    }
+
+    void AdoptedProcess::terminate() {
+        if (m_running)
+            ::kill(m_pid, SIGTERM);
+    }
+
+    void AdoptedProcess::kill() {
+        if (m_running)
+            ::kill(m_pid, SIGKILL);
+    }
+
+    void AdoptedProcess::check() {
+        // check flag
+        if (!m_running)
+            return;
+
+        // still the same process
+        if (isRunning(m_pid, m_startTime))
+            return;
+
+        // reset flag
+        m_running = false;
+
+        // stop watching
+        if (m_notifier)
+            m_notifier->setEnabled(false);
+        if (m_timer)
+            m_timer->stop();
+
+        // emit signal
+        emit finished();
+    }
+}
@@ -0,0 +1,65 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+
+#ifndef SDDM_ADOPTEDPROCESS_H
+#define SDDM_ADOPTEDPROCESS_H
+
+#include <QObject>
+
+class QSocketNotifier;
+class QTimer;
+
+namespace SDDM {
+    class AdoptedProcess : public QObject {
+        Q_OBJECT
+        Q_DISABLE_COPY(AdoptedProcess)
+    public:
+        explicit AdoptedProcess(qint64 pid, QObject *parent = 0);
+        ~AdoptedProcess();
+
+        qint64 pid() const;
+        bool isRunning() const;
+
+        static qulonglong startTime(qint64 pid);
+        static bool isRunning(qint64 pid, qulonglong startTime);
+
+    public slots:
+        void terminate();
+        void kill();
+
+    signals:
+        void finished();
+
+    private slots:
+        void check();
+
+    private:
+        qint64 m_pid { 0 };
+        qulonglong m_startTime { 0 };
+
+        bool m_running { false };
+
+        int m_fd { -1 };
+        QSocketNotifier *m_notifier { nullptr };
+        QTimer *m_timer { nullptr };
+    };
+}
+
+#endif // SDDM_ADOPTEDPROCESS_H
@@ -19,7 +19,9 @@
 
 #include "Authenticator.h"
 
+#include "AdoptedProcess.h"
 #include "Configuration.h"
+#include "Constants.h"
 #include "DaemonApp.h"
 #include "Display.h"
 #include "DisplayManager.h"
@@ -29,7 +31,9 @@
 #include <QDebug>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QTextStream>
+#include <QTimer>
 
 #ifdef USE_PAM
 #include <security/pam_appl.h>
@@ -38,11 +42,34 @@
 #include <shadow.h>
 #endif
 
+#define STOP_TIMEOUT 5000
+
 #include <grp.h>
 #include <pwd.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 namespace SDDM {
+    QString userRuntimeDir(const QString &xdgRuntimeDir, uid_t uid, gid_t gid) {
+        // prefer the runtime dir logind created for the session
+        if (!xdgRuntimeDir.isEmpty() && QFileInfo(xdgRuntimeDir).isDir())
+            return xdgRuntimeDir;
+
+        // otherwise use one of our own
+        QString path = QString("%1/user-%2").arg(RUNTIME_DIR).arg(uid);
+        QByteArray encoded = QFile::encodeName(path);
+        if (!QDir().mkpath(path) || chown(encoded.constData(), uid, gid) || chmod(encoded.constData(), 0700)) {
+            // log message
+            qWarning() << " DAEMON: Failed to create runtime dir" << path;
+
+            // fall back to the home dir
+            return QString();
+        }
+
+        // return path
+        return path;
+    }
+
 #ifdef USE_PAM
     class PamService {
     public:
@@ -138,13 +165,112 @@ namespace SDDM {
     }
 
     Authenticator::~Authenticator() {
-        stop();
+        // check flag
+        if (!m_started)
+            return;
+
+        // the daemon is exiting and the shutdown deadline passed
+        if (m_adopted) {
+            m_adopted->kill();
+            return;
+        }
+
+        process->kill();
+        process->waitForFinished();
     }
 
     Display *Authenticator::display() const {
         return m_display;
     }
 
+    bool Authenticator::isStarted() const {
+        return m_started;
+    }
+
+    QString Authenticator::user() const {
+        if (m_adopted != nullptr)
+            return m_adoptedUser;
+
+        return (process != nullptr) ? process->user() : QString();
+    }
+
+    qint64 Authenticator::pid() const {
+        if (m_adopted != nullptr)
+            return m_adopted->pid();
+
+        return (process != nullptr) ? process->pid() : 0;
+    }
+
+    bool Authenticator::adopt(qint64 pid, const QString &user) {
+        // check flag
+        if (m_started)
+            return false;
+
+        // watch the session a previous daemon started
+        m_adopted = new AdoptedProcess(pid, this);
+
+        // check if it is still there
+        if (!m_adopted->isRunning()) {
+            delete m_adopted;
+            m_adopted = nullptr;
+            return false;
+        }
+
+        // stopped is emitted on finish
+        connect(m_adopted, SIGNAL(finished()), this, SLOT(finished()));
+
+        // log message
+        qDebug() << " DAEMON: User session adopted, pid" << pid;
+
+        // register to the display manager
+        m_adoptedName = QString("Session%1").arg(daemonApp->newSessionId());
+        m_adoptedUser = user;
+        daemonApp->displayManager()->AddSession(m_adoptedName, m_display->seat()->name(), m_adoptedUser);
+
+        // set flags
+        m_started = true;
+        m_stopping = false;
+        m_registered = true;
+
+        // return success
+        return true;
+    }
+
+    qint64 Authenticator::detach() {
+        // check flag
+        if (!m_started)
+            return 0;
+
+        // get pid
+        qint64 result = pid();
+
+        if (m_adopted) {
+            delete m_adopted;
+            m_adopted = nullptr;
+        } else {
+            // leave the process running, the daemon exits right after this
+            process->disconnect(this);
+            process->setParent(nullptr);
+            process = nullptr;
+        }
+
+#ifdef USE_PAM
+        // the session stays open, pam_close_session is never called for it
+        m_pam = nullptr;
+#endif
+
+        // reset flags
+        m_started = false;
+        m_stopping = false;
+        m_registered = false;
+
+        // log message
+        qDebug() << " DAEMON: User session detached, pid" << result;
+
+        // return pid
+        return result;
+    }
+
     bool Authenticator::start(const QString &user, const QString &session) {
         return doStart(user, QString(), session, true);
     }
@@ -309,6 +435,10 @@ namespace SDDM {
         process->setUid(pw->pw_uid);
         process->setGid(pw->pw_gid);
 
+        // authority file and session log
+        QString authPath = QString("%1/.Xauthority").arg(pw->pw_dir);
+        QString logPath = QString("%1/.xsession-errors").arg(pw->pw_dir);
+
         // set process environment
         QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
 #ifdef USE_PAM
@@ -333,6 +463,20 @@ namespace SDDM {
         // we strdup'd the string before in this branch
         free(mapped);
 #endif
+        // keep both off the home directory, named per display so that
+        // sessions of the same user on several seats do not share them
+        if (daemonApp->configuration()->userRuntimeFiles()) {
+            QString runtimeDir = userRuntimeDir(env.value("XDG_RUNTIME_DIR"), pw->pw_uid, pw->pw_gid);
+            if (!runtimeDir.isEmpty()) {
+                authPath = QString("%1/sddm-xauth-%2").arg(runtimeDir).arg(m_display->name());
+                logPath = QString("%1/sddm-session-%2.log").arg(runtimeDir).arg(m_display->name());
+
+                // removed when the session ends
+                m_runtimeAuthPath = authPath;
+            }
+        }
+        process->setAuthPath(authPath);
+
         env.insert("HOME", pw->pw_dir);
         env.insert("PWD", pw->pw_dir);
         env.insert("SHELL", pw->pw_shell);
@@ -340,44 +484,63 @@ namespace SDDM {
         env.insert("LOGNAME", pw->pw_name);
         env.insert("PATH", daemonApp->configuration()->defaultPath());
         env.insert("DISPLAY", m_display->name());
-        env.insert("XAUTHORITY", QString("%1/.Xauthority").arg(pw->pw_dir));
+        env.insert("XAUTHORITY", authPath);
         env.insert("XDG_SEAT", seat->name());
         env.insert("XDG_SEAT_PATH", daemonApp->displayManager()->seatPath(seat->name()));
         env.insert("XDG_SESSION_PATH", daemonApp->displayManager()->sessionPath(process->name()));
-        env.insert("XDG_VTNR", QString::number(m_display->terminalId()));
+        if (m_display->terminalId() > 0)
+            env.insert("XDG_VTNR", QString::number(m_display->terminalId()));
         env.insert("DESKTOP_SESSION", sessionName);
         env.insert("GDMSESSION", sessionName);
         process->setProcessEnvironment(env);
 
-        // redirect error output to ~/.xession-errors
-        process->setStandardErrorFile(QString("%1/.xsession-errors").arg(pw->pw_dir));
+        // route all output to the session log, so the session does not
+        // depend on pipes to the daemon
+        process->setLog(ChildProcess::logSink(daemonApp->configuration()->sessionLog()), sessionName, logPath);
 
-        // start session
-        process->start(daemonApp->configuration()->sessionCommand(), { command });
+        // set scheduling, io and oom policy
+        process->setPolicy(daemonApp->configuration()->sessionPolicy());
 
-        // connect signal
+        // connect signals
         connect(process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(finished()));
+        connect(process, SIGNAL(started()), this, SLOT(sessionStarted()));
+        connect(process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(sessionError(QProcess::ProcessError)));
 
-        // wait for started
-        if (!process->waitForStarted()) {
-            // log error
-            qDebug() << " DAEMON: Failed to start user session.";
+        // set flags
+        m_started = true;
+        m_stopping = false;
 
-            // return fail
-            return false;
-        }
+        // start session, started is emitted once the process is running
+        process->start(daemonApp->configuration()->sessionCommand(), { command });
+
+        // check flag, the process may have failed already
+        return m_started;
+    }
 
+    void Authenticator::sessionStarted() {
         // log message
         qDebug() << " DAEMON: User session started.";
 
         // register to the display manager
-        daemonApp->displayManager()->AddSession(process->name(), seat->name(), pw->pw_name);
+        daemonApp->displayManager()->AddSession(process->name(), m_display->seat()->name(), process->user());
 
         // set flag
-        m_started = true;
+        m_registered = true;
 
-        // return success
-        return true;
+        // emit signal
+        emit started();
+    }
+
+    void Authenticator::sessionError(QProcess::ProcessError error) {
+        // only handle processes that never ran, finished covers the rest
+        if (error != QProcess::FailedToStart)
+            return;
+
+        // log error
+        qCritical() << " DAEMON: Failed to start user session.";
+
+        // clean up
+        finished();
     }
 
     void Authenticator::stop() {
@@ -385,15 +548,24 @@ namespace SDDM {
         if (!m_started)
             return;
 
+        // check flag
+        if (m_stopping)
+            return;
+
+        // set flag
+        m_stopping = true;
+
         // log message
         qDebug() << " DAEMON: User session stopping...";
 
-        // terminate process
-        process->terminate();
-
-        // wait for finished
-        if (!process->waitForFinished(5000))
-            process->kill();
+        // terminate process, kill it if it does not finish in time, stopped is emitted on finish
+        if (m_adopted) {
+            m_adopted->terminate();
+            QTimer::singleShot(STOP_TIMEOUT, m_adopted, SLOT(kill()));
+        } else {
+            process->terminate();
+            QTimer::singleShot(STOP_TIMEOUT, process, SLOT(kill()));
+        }
     }
 
     void Authenticator::finished() {
@@ -401,18 +573,32 @@ namespace SDDM {
         if (!m_started)
             return;
 
-        // reset flag
+        // reset flags
         m_started = false;
+        m_stopping = false;
 
         // log message
         qDebug() << " DAEMON: User session ended.";
 
         // unregister from the display manager
-        daemonApp->displayManager()->RemoveSession(process->name());
+        if (m_registered)
+            daemonApp->displayManager()->RemoveSession(m_adopted ? m_adoptedName : process->name());
+        m_registered = false;
 
         // delete session process
-        process->deleteLater();
-        process = nullptr;
+        if (m_adopted) {
+            m_adopted->deleteLater();
+            m_adopted = nullptr;
+        } else {
+            process->deleteLater();
+            process = nullptr;
+        }
+
+        // remove the authority file kept in the runtime dir
+        if (!m_runtimeAuthPath.isEmpty()) {
+            QFile::remove(m_runtimeAuthPath);
+            m_runtimeAuthPath.clear();
+        }
 
 #ifdef USE_PAM
         if (m_pam) {
@@ -21,11 +21,13 @@
 #define SDDM_AUTHENTICATOR_H
 
 #include <QObject>
+#include <QProcess>
 
 namespace SDDM {
 #ifdef USE_PAM
     class PamService;
 #endif
+    class AdoptedProcess;
     class Display;
     class Session;
 
@@ -38,6 +40,14 @@ namespace SDDM {
 
         Display *display() const;
 
+        bool isStarted() const;
+
+        QString user() const;
+        qint64 pid() const;
+
+        bool adopt(qint64 pid, const QString &user);
+        qint64 detach();
+
     public slots:
         bool start(const QString &user, const QString &session);
         bool start(const QString &user, const QString &password, const QString &session);
@@ -45,13 +55,20 @@ namespace SDDM {
         void stop();
         void finished();
 
+    private slots:
+        void sessionStarted();
+        void sessionError(QProcess::ProcessError error);
+
     signals:
+        void started();
         void stopped();
 
     private:
         bool doStart(const QString &user, const QString &password, const QString &session, bool passwordless);
 
         bool m_started { false };
+        bool m_stopping { false };
+        bool m_registered { false };
         Display *m_display { nullptr };
 
 #ifdef USE_PAM
@@ -59,6 +76,11 @@ namespace SDDM {
 #endif
 
         Session *process { nullptr };
+
+        AdoptedProcess *m_adopted { nullptr };
+        QString m_adoptedName { "" };
+        QString m_adoptedUser { "" };
+        QString m_runtimeAuthPath { "" };
     };
 }
 
@@ -0,0 +1,246 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+
+#include "ChildProcess.h"
+
+#include "Configuration.h"
+#include "DaemonApp.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define JOURNAL_SOCKET "/run/systemd/journal/stdout"
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+
+namespace SDDM {
+    void childWarning(const char *message) {
+        // runs between fork and exec, where only async-signal-safe calls are
+        // allowed, so no qWarning, a failed policy is not fatal anyway
+        ssize_t result = write(STDERR_FILENO, message, strlen(message));
+        Q_UNUSED(result);
+    }
+
+    ChildProcess::ChildProcess(QObject *parent) : QProcess(parent) {
+    }
+
+    ChildProcess::LogSink ChildProcess::logSink(const QString &name) {
+        if (name == "file")
+            return LogFile;
+        if (name == "journal")
+            return LogJournal;
+
+        // log message
+        if (name != "none")
+            qWarning() << " DAEMON: Unknown log sink" << name << "- discarding output.";
+
+        return LogNone;
+    }
+
+    void ChildProcess::setLog(LogSink sink, const QString &identifier, const QString &path, bool standardOutput) {
+        m_logSink = sink;
+        m_logOutput = standardOutput;
+        m_logIdentifier = identifier.toLocal8Bit();
+        m_logPath = QFile::encodeName(path);
+        m_logOldPath = QFile::encodeName(path + ".old");
+        m_logDir = QFile::encodeName(QFileInfo(path).absolutePath());
+        m_logSizeLimit = qint64(daemonApp->configuration()->logSizeLimit()) * 1024;
+
+        // nothing goes through pipes to the daemon, the child opens the sink
+        // itself and falls back to /dev/null if it cannot, the daemon never
+        // touches the file as the session log is in a directory of the user
+        if (standardOutput)
+            setStandardOutputFile("/dev/null");
+        setStandardErrorFile("/dev/null");
+    }
+
+    void ChildProcess::setPolicy(const ProcessPolicy &policy) {
+        m_hasNice = policy.hasNice;
+        m_nice = policy.nice;
+
+        // scheduling policy
+        m_schedPolicy = -1;
+        m_schedPriority = policy.schedPriority;
+        if (policy.schedPolicy == "other")
+            m_schedPolicy = SCHED_OTHER;
+        else if (policy.schedPolicy == "batch")
+            m_schedPolicy = SCHED_BATCH;
+        else if (policy.schedPolicy == "idle")
+            m_schedPolicy = SCHED_IDLE;
+        else if (policy.schedPolicy == "fifo")
+            m_schedPolicy = SCHED_FIFO;
+        else if (policy.schedPolicy == "rr")
+            m_schedPolicy = SCHED_RR;
+        else if (!policy.schedPolicy.isEmpty())
+            qWarning() << " DAEMON: Unknown scheduling policy" << policy.schedPolicy;
+
+        // the static priority is only used by the realtime policies
+        if (m_schedPolicy != SCHED_FIFO && m_schedPolicy != SCHED_RR)
+            m_schedPriority = 0;
+
+        // io priority
+        int ioClass = 0;
+        if (policy.ioSchedClass == "realtime")
+            ioClass = 1;
+        else if (policy.ioSchedClass == "best-effort")
+            ioClass = 2;
+        else if (policy.ioSchedClass == "idle")
+            ioClass = 3;
+        else if (!policy.ioSchedClass.isEmpty())
+            qWarning() << " DAEMON: Unknown io scheduling class" << policy.ioSchedClass;
+        m_ioPriority = (ioClass > 0) ? (ioClass << IOPRIO_CLASS_SHIFT) | qBound(0, policy.ioPriority, 7) : -1;
+
+        // oom score, written as it is to procfs
+        m_oomScoreAdjust = policy.hasOomScoreAdjust ? QByteArray::number(qBound(-1000, policy.oomScoreAdjust, 1000)) : QByteArray();
+
+        // cpu affinity
+        m_cpuAffinity = policy.cpuAffinity;
+    }
+
+    void ChildProcess::setupChildProcess() {
+        restoreSignalMask();
+        redirectOutput();
+        applyPolicy();
+    }
+
+    void ChildProcess::restoreSignalMask() {
+        sigset_t set;
+        sigemptyset(&set);
+
+        // the daemon blocks the signals it reads from its signal handler,
+        // unblock them again so the child can be terminated
+        sigprocmask(SIG_SETMASK, &set, nullptr);
+    }
+
+    void ChildProcess::applyPolicy() {
+        // set nice level
+        if (m_hasNice && setpriority(PRIO_PROCESS, 0, m_nice))
+            childWarning(" DAEMON: Failed to set nice level.\n");
+
+        // set scheduling policy
+        if (m_schedPolicy != -1) {
+            struct sched_param param;
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = m_schedPriority;
+
+            if (sched_setscheduler(0, m_schedPolicy, &param))
+                childWarning(" DAEMON: Failed to set scheduling policy.\n");
+        }
+
+        // set io priority, glibc has no wrapper for it
+        if (m_ioPriority != -1 && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, m_ioPriority))
+            childWarning(" DAEMON: Failed to set io priority.\n");
+
+        // set oom score
+        if (!m_oomScoreAdjust.isEmpty()) {
+            int fd = open("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+            if (fd == -1 || write(fd, m_oomScoreAdjust.constData(), m_oomScoreAdjust.size()) != m_oomScoreAdjust.size())
+                childWarning(" DAEMON: Failed to set oom score.\n");
+            if (fd != -1)
+                close(fd);
+        }
+
+        // set cpu affinity
+        if (!m_cpuAffinity.isEmpty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu: m_cpuAffinity) {
+                if (cpu >= 0 && cpu < CPU_SETSIZE)
+                    CPU_SET(cpu, &set);
+            }
+
+            if (sched_setaffinity(0, sizeof(set), &set))
+                childWarning(" DAEMON: Failed to set cpu affinity.\n");
+        }
+    }
+
+    void ChildProcess::redirectOutput() {
+        // route output to the log sink
+        int fd = openLog();
+        if (fd == -1)
+            return;
+
+        if (m_logOutput)
+            dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+
+        close(fd);
+    }
+
+    int ChildProcess::openLog() const {
+        if (m_logSink == LogFile) {
+            // create log dir if not existing
+            mkdir(m_logDir.constData(), 0755);
+
+            // rotate the log when it grew over the limit, one old copy is kept
+            struct stat info;
+            if (m_logSizeLimit > 0 && stat(m_logPath.constData(), &info) == 0 && info.st_size > m_logSizeLimit)
+                rename(m_logPath.constData(), m_logOldPath.constData());
+
+            return open(m_logPath.constData(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        }
+
+        if (m_logSink != LogJournal)
+            return -1;
+
+        // connect to the journal stream socket
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+            return -1;
+
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, JOURNAL_SOCKET, sizeof(address.sun_path) - 1);
+
+        if (connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == -1) {
+            close(fd);
+            return -1;
+        }
+
+        // stream header: identifier, unit, priority, level prefix,
+        // forward to syslog, kmsg and console
+        QByteArray header = m_logIdentifier + "\n\n6\n0\n0\n0\n0\n";
+        if (write(fd, header.constData(), header.size()) != header.size()) {
+            close(fd);
+            return -1;
+        }
+
+        // we only write
+        shutdown(fd, SHUT_RD);
+
+        // return descriptor
+        return fd;
+    }
+}
@@ -0,0 +1,71 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+
+#ifndef SDDM_CHILDPROCESS_H
+#define SDDM_CHILDPROCESS_H
+
+#include <QProcess>
+
+namespace SDDM {
+    class ProcessPolicy;
+
+    class ChildProcess : public QProcess {
+        Q_OBJECT
+        Q_DISABLE_COPY(ChildProcess)
+    public:
+        enum LogSink { LogNone, LogFile, LogJournal };
+
+        explicit ChildProcess(QObject *parent = 0);
+
+        static LogSink logSink(const QString &name);
+
+        void setLog(LogSink sink, const QString &identifier, const QString &path, bool standardOutput = true);
+        void setPolicy(const ProcessPolicy &policy);
+
+    protected:
+        void setupChildProcess();
+
+        void restoreSignalMask();
+        void applyPolicy();
+        void redirectOutput();
+
+    private:
+        int openLog() const;
+
+        LogSink m_logSink { LogNone };
+        bool m_logOutput { false };
+
+        QByteArray m_logPath;
+        QByteArray m_logOldPath;
+        QByteArray m_logDir;
+        qint64 m_logSizeLimit { 0 };
+        QByteArray m_logIdentifier;
+
+        bool m_hasNice { false };
+        int m_nice { 0 };
+        int m_schedPolicy { -1 };
+        int m_schedPriority { 0 };
+        int m_ioPriority { -1 };
+        QByteArray m_oomScoreAdjust;
+        QList<int> m_cpuAffinity;
+    };
+}
+
+#endif // SDDM_CHILDPROCESS_H
@@ -22,9 +22,13 @@
 #include "Configuration.h"
 #include "Constants.h"
 #include "DisplayManager.h"
+#include "GreeterZygote.h"
 #include "PowerManager.h"
+#include "Readahead.h"
 #include "SeatManager.h"
+#include "ServiceNotifier.h"
 #include "SignalHandler.h"
+#include "SocketServer.h"
 
 #ifdef USE_QT5
 #include "MessageHandler.h"
@@ -36,6 +40,8 @@
 
 #include <iostream>
 
+#define SHUTDOWN_TIMEOUT 5000
+
 namespace SDDM {
     DaemonApp *DaemonApp::self = nullptr;
 
@@ -56,12 +62,19 @@ namespace SDDM {
         // set testing parameter
         m_configuration->testing = (arguments().indexOf("--test-mode") != -1);
 
+        // create service notifier, takes over what the service manager passed in
+        m_serviceNotifier = new ServiceNotifier(this);
+
         // create display manager
         m_displayManager = new DisplayManager(this);
 
         // create power manager
         m_powerManager = new PowerManager(this);
 
+        // create socket server, all greeters talk to the daemon through it
+        m_socketServer = new SocketServer(this);
+        m_socketServer->start();
+
         // create seat manager
         m_seatManager = new SeatManager(this);
 
@@ -69,22 +82,52 @@ namespace SDDM {
         connect(m_seatManager, SIGNAL(seatCreated(QString)), m_displayManager, SLOT(AddSeat(QString)));
         connect(m_seatManager, SIGNAL(seatRemoved(QString)), m_displayManager, SLOT(RemoveSeat(QString)));
 
+        // create greeter zygote after the seat manager, so it outlives the greeters
+        if (m_configuration->greeterZygote())
+            m_greeterZygote = new GreeterZygote(this);
+
         // create signal handler
         SignalHandler *signalHandler = new SignalHandler(this);
 
-        // initialize signal signalHandler
-        SignalHandler::initialize();
+        // reload configuration when SIGHUP received
+        connect(signalHandler, SIGNAL(sighupReceived()), this, SLOT(reload()));
+
+        // shut down when SIGINT, SIGTERM received
+        connect(signalHandler, SIGNAL(sigintReceived()), this, SLOT(shutdown()));
+        connect(signalHandler, SIGNAL(sigtermReceived()), this, SLOT(shutdown()));
 
-        // quit when SIGHUP, SIGINT, SIGTERM received
-        connect(signalHandler, SIGNAL(sighupReceived()), this, SLOT(quit()));
-        connect(signalHandler, SIGNAL(sigintReceived()), this, SLOT(quit()));
-        connect(signalHandler, SIGNAL(sigtermReceived()), this, SLOT(quit()));
+        // dump state when SIGUSR1 received
+        connect(signalHandler, SIGNAL(sigusr1Received()), m_seatManager, SLOT(dumpState()));
+
+        // probe power capabilities again when SIGUSR2 received
+        connect(signalHandler, SIGNAL(sigusr2Received()), m_powerManager, SLOT(refresh()));
+
+        // quit when all seats stopped
+        connect(m_seatManager, SIGNAL(stopped()), this, SLOT(quit()));
 
         // log message
         qDebug() << " DAEMON: Starting...";
 
-        // add a seat
-        m_seatManager->createSeat("seat0");
+        // read the greeter files ahead while the display server starts
+        m_readahead = new Readahead(this);
+        m_readahead->start();
+
+        // add seats, this starts the display server of seat0 right away
+        m_seatManager->initialize();
+
+        // talk to the bus once the first display server is on its way,
+        // greeters get the capabilities as soon as they are known
+        QTimer::singleShot(0, m_displayManager, SLOT(initialize()));
+        QTimer::singleShot(0, m_powerManager, SLOT(initialize()));
+    }
+
+    DaemonApp::~DaemonApp() {
+        // remaining children are killed here, before the objects they use are gone
+        delete m_seatManager;
+        m_seatManager = nullptr;
+
+        // keeps the socket open when it is passed to the next daemon
+        m_socketServer->stop();
     }
 
     QString DaemonApp::hostName() const {
@@ -99,17 +142,72 @@ namespace SDDM {
         return m_displayManager;
     }
 
+    GreeterZygote *DaemonApp::greeterZygote() const {
+        return m_greeterZygote;
+    }
+
     PowerManager *DaemonApp::powerManager() const {
         return m_powerManager;
     }
 
+    Readahead *DaemonApp::readahead() const {
+        return m_readahead;
+    }
+
     SeatManager *DaemonApp::seatManager() const {
         return m_seatManager;
     }
 
+    ServiceNotifier *DaemonApp::serviceNotifier() const {
+        return m_serviceNotifier;
+    }
+
+    SocketServer *DaemonApp::socketServer() const {
+        return m_socketServer;
+    }
+
     int DaemonApp::newSessionId() {
         return m_lastSessionId++;
     }
+
+    void DaemonApp::reload() {
+        // log message
+        qDebug() << " DAEMON: Reloading configuration...";
+
+        // tell the service manager
+        m_serviceNotifier->reloading();
+
+        // read configuration again, running displays keep their settings
+        m_configuration->load();
+
+        // done
+        m_serviceNotifier->reloaded();
+    }
+
+    void DaemonApp::shutdown() {
+        // check flag
+        if (m_stopping)
+            return;
+
+        // set flag
+        m_stopping = true;
+
+        // log message
+        qDebug() << " DAEMON: Shutting down...";
+
+        // tell the service manager
+        m_serviceNotifier->stopping();
+
+        // leave running user sessions to the next daemon
+        if (m_configuration->preserveSessions() && !m_configuration->testing)
+            m_seatManager->preserveSessions();
+
+        // quit on the deadline, whatever is still running gets killed on exit
+        QTimer::singleShot(SHUTDOWN_TIMEOUT, this, SLOT(quit()));
+
+        // stop all seats, they signal every child at once
+        m_seatManager->stop();
+    }
 }
 
 int main(int argc, char **argv) {
@@ -126,6 +224,9 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
+    // block signals before any thread is started
+    SDDM::SignalHandler::initialize();
+
     // create application
     SDDM::DaemonApp app(argc, argv);
 
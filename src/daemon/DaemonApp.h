@@ -27,14 +27,19 @@
 namespace SDDM {
     class Configuration;
     class DisplayManager;
+    class GreeterZygote;
     class PowerManager;
+    class Readahead;
     class SeatManager;
+    class ServiceNotifier;
+    class SocketServer;
 
     class DaemonApp : public QCoreApplication {
         Q_OBJECT
         Q_DISABLE_COPY(DaemonApp)
     public:
         explicit DaemonApp(int argc, char **argv);
+        ~DaemonApp();
 
         static DaemonApp *instance() { return self; }
 
@@ -42,21 +47,34 @@ namespace SDDM {
 
         Configuration *configuration() const;
         DisplayManager *displayManager() const;
+        GreeterZygote *greeterZygote() const;
         PowerManager *powerManager() const;
+        Readahead *readahead() const;
         SeatManager *seatManager() const;
+        ServiceNotifier *serviceNotifier() const;
+        SocketServer *socketServer() const;
 
     public slots:
         int newSessionId();
 
+        void reload();
+        void shutdown();
+
     private:
         static DaemonApp *self;
 
         int m_lastSessionId { 0 };
 
+        bool m_stopping { false };
+
         Configuration *m_configuration { nullptr };
         DisplayManager *m_displayManager { nullptr };
+        GreeterZygote *m_greeterZygote { nullptr };
         PowerManager *m_powerManager { nullptr };
+        Readahead *m_readahead { nullptr };
         SeatManager *m_seatManager { nullptr };
+        ServiceNotifier *m_serviceNotifier { nullptr };
+        SocketServer *m_socketServer { nullptr };
     };
 }
 
@@ -19,11 +19,14 @@
 
 #include "Display.h"
 
+#include "AdoptedProcess.h"
 #include "Authenticator.h"
 #include "Configuration.h"
 #include "DaemonApp.h"
 #include "DisplayServer.h"
+#include "Readahead.h"
 #include "Seat.h"
+#include "ServiceNotifier.h"
 #include "SocketServer.h"
 #include "Greeter.h"
 
@@ -32,6 +35,11 @@
 #include <QFile>
 #include <QTimer>
 
+#include <signal.h>
+#include <unistd.h>
+
+#define GREETER_CRASH_LIMIT 3
+
 namespace SDDM {
     QString generateName(int length) {
         QString digits = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
@@ -58,23 +66,37 @@ namespace SDDM {
         m_authenticator(new Authenticator(this)),
         m_displayServer(new DisplayServer(this)),
         m_seat(parent),
-        m_socketServer(new SocketServer(this)),
-        m_greeter(new Greeter(this)) {
+        m_greeter(new Greeter(this)),
+        m_greeterRestartTimer(new QTimer(this)) {
 
         m_display = QString(":%1").arg(m_displayId);
+        m_lastTransition = QDateTime::currentDateTime();
+
+        // update state after user session started
+        connect(m_authenticator, SIGNAL(started()), this, SLOT(sessionStarted()));
+
+        // reset display after user session ended
+        connect(m_authenticator, SIGNAL(stopped()), this, SLOT(sessionStopped()));
 
-        // restart display after user session ended
-        connect(m_authenticator, SIGNAL(stopped()), this, SLOT(stop()));
+        // start greeter after display server is ready
+        connect(m_displayServer, SIGNAL(started()), this, SLOT(displayServerStarted()));
 
         // restart display after display server ended
-        connect(m_displayServer, SIGNAL(stopped()), this, SLOT(stop()));
+        connect(m_displayServer, SIGNAL(stopped()), this, SLOT(displayServerStopped()));
 
-        // connect login signal
-        connect(m_socketServer, SIGNAL(login(QLocalSocket*,QString,QString,QString)), this, SLOT(login(QLocalSocket*,QString,QString,QString)));
+        // restart display after greeter failed
+        connect(m_greeter, SIGNAL(failed()), this, SLOT(greeterFailed()));
 
-        // connect login result signals
-        connect(this, SIGNAL(loginFailed(QLocalSocket*)), m_socketServer, SLOT(loginFailed(QLocalSocket*)));
-        connect(this, SIGNAL(loginSucceeded(QLocalSocket*)), m_socketServer, SLOT(loginSucceeded(QLocalSocket*)));
+        // restart a crashed greeter when the backoff delay expires
+        m_greeterRestartTimer->setSingleShot(true);
+        connect(m_greeterRestartTimer, SIGNAL(timeout()), this, SLOT(restartGreeter()));
+
+        // the greeter pid is only known once it runs
+        connect(m_greeter, SIGNAL(started()), this, SIGNAL(stateChanged()));
+
+        // connect login result signals, the socket server routes logins here
+        connect(this, SIGNAL(loginFailed(QLocalSocket*)), daemonApp->socketServer(), SLOT(loginFailed(QLocalSocket*)));
+        connect(this, SIGNAL(loginSucceeded(QLocalSocket*)), daemonApp->socketServer(), SLOT(loginSucceeded(QLocalSocket*)));
 
         // get auth dir
         QString authDir = daemonApp->configuration()->authDir();
@@ -88,13 +110,18 @@ namespace SDDM {
 
         // set auth path
         m_authPath = QString("%1/A%2-%3").arg(authDir).arg(m_display).arg(generateName(6));
-
-        // set socket name
-        m_socket = QString("sddm-%1-%2").arg(m_display).arg(generateName(6));
     }
 
     Display::~Display() {
+        // nobody is listening anymore
+        blockSignals(true);
+
+        // stop display
         stop();
+
+        // the daemon is exiting, children are stopped by their destructors
+        if (!m_detached)
+            QFile::remove(m_authPath);
     }
 
     const int Display::displayId() const {
@@ -117,6 +144,136 @@ namespace SDDM {
         return m_seat;
     }
 
+    bool Display::isVirtual() const {
+        return !m_geometry.isEmpty();
+    }
+
+    const QString &Display::geometry() const {
+        return m_geometry;
+    }
+
+    int Display::depth() const {
+        return m_depth;
+    }
+
+    void Display::setVirtual(const QString &geometry, int depth) {
+        m_geometry = geometry;
+        m_depth = depth;
+    }
+
+    qulonglong Display::memoryUsage() const {
+        qulonglong result = 0;
+
+        // resident pages of the display server and the greeter
+        for (qint64 pid: { serverPid(), greeterPid() }) {
+            QFile file(QString("/proc/%1/statm").arg(pid));
+            if (pid > 0 && file.open(QIODevice::ReadOnly))
+                result += file.readAll().split(' ').value(1).toULongLong() * sysconf(_SC_PAGESIZE);
+        }
+
+        return result;
+    }
+
+    qulonglong Display::cpuTime() const {
+        qulonglong result = 0;
+
+        // user and system time of the display server and the greeter
+        for (qint64 pid: { serverPid(), greeterPid() }) {
+            QFile file(QString("/proc/%1/stat").arg(pid));
+            if (pid <= 0 || !file.open(QIODevice::ReadOnly))
+                continue;
+
+            // fields are counted after the command name
+            QByteArray stat = file.readAll();
+            QList<QByteArray> fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+            result += fields.value(11).toULongLong() + fields.value(12).toULongLong();
+        }
+
+        // convert clock ticks to milliseconds
+        return result * 1000 / sysconf(_SC_CLK_TCK);
+    }
+
+    Display::State Display::state() const {
+        return m_state;
+    }
+
+    QString Display::sessionUser() const {
+        return m_authenticator->user();
+    }
+
+    qint64 Display::sessionPid() const {
+        return m_authenticator->pid();
+    }
+
+    qint64 Display::greeterPid() const {
+        return m_greeter->pid();
+    }
+
+    qint64 Display::serverPid() const {
+        return m_displayServer->pid();
+    }
+
+    const QDateTime &Display::lastTransition() const {
+        return m_lastTransition;
+    }
+
+    QString Display::stateName(State state) {
+        switch (state) {
+            case Stopped:
+                return "Stopped";
+            case StartingServer:
+                return "StartingServer";
+            case ServerReady:
+                return "ServerReady";
+            case GreeterUp:
+                return "GreeterUp";
+            case Authenticating:
+                return "Authenticating";
+            case SessionRunning:
+                return "SessionRunning";
+            case TearingDown:
+                return "TearingDown";
+        }
+
+        return QString();
+    }
+
+    void Display::setState(State state) {
+        // check state
+        if (m_state == state)
+            return;
+
+        // log message
+        qDebug() << " DAEMON: Display" << m_display << "state:" << stateName(m_state) << "->" << stateName(state);
+
+        // set state
+        m_state = state;
+        m_lastTransition = QDateTime::currentDateTime();
+
+        // emit signal
+        emit stateChanged();
+    }
+
+    const QString &Display::failureReason() const {
+        return m_failureReason;
+    }
+
+    qint64 Display::uptime() const {
+        return m_uptime.isValid() ? m_uptime.elapsed() : 0;
+    }
+
+    void Display::markActive() {
+        m_lastActive.restart();
+    }
+
+    qint64 Display::inactiveTime() const {
+        return m_lastActive.isValid() ? m_lastActive.elapsed() : 0;
+    }
+
+    int Display::greeterCrashes() const {
+        return m_greeterCrashes;
+    }
+
     void Display::addCookie(const QString &file) {
         // log message
         qDebug() << " DAEMON: Adding cookie to" << file;
@@ -139,11 +296,7 @@ namespace SDDM {
         pclose(fp);
     }
 
-    void Display::start() {
-        // check flag
-        if (m_started)
-            return;
-
+    void Display::generateCookie() {
         // generate cookie
         std::random_device rd;
         std::mt19937 gen(rd());
@@ -156,6 +309,15 @@ namespace SDDM {
         const char *digits = "0123456789abcdef";
         for (int i = 0; i < 32; ++i)
             m_cookie[i] = digits[dis(gen)];
+    }
+
+    void Display::start() {
+        // check state
+        if (m_state != Stopped)
+            return;
+
+        // generate cookie
+        generateCookie();
 
         // generate auth file
         addCookie(m_authPath);
@@ -164,80 +326,379 @@ namespace SDDM {
         m_displayServer->setDisplay(m_display);
         m_displayServer->setAuthPath(m_authPath);
 
-        // start display server
-        m_displayServer->start();
+        // start uptime timer
+        m_uptime.start();
 
-        if ((daemonApp->configuration()->first || daemonApp->configuration()->autoRelogin()) &&
-            !daemonApp->configuration()->autoUser().isEmpty() && !daemonApp->configuration()->lastSession().isEmpty()) {
-            // reset first flag
-            daemonApp->configuration()->first = false;
+        // a new display starts on the active terminal
+        m_lastActive.start();
 
-            // set flags
-            m_started = true;
+        // set state
+        setState(StartingServer);
 
-            // start session
-            m_authenticator->start(daemonApp->configuration()->autoUser(), daemonApp->configuration()->lastSession());
+        // start display server, the greeter follows when it is ready
+        if (!m_displayServer->start() && m_state == StartingServer)
+            fail("Failed to start the display server");
+    }
 
-            // return
-            return;
+    bool Display::adopt(const QVariantMap &state) {
+        // check state
+        if (m_state != Stopped)
+            return false;
+
+        qint64 serverPid = state.value("ServerPid").toLongLong();
+        qint64 sessionPid = state.value("SessionPid").toLongLong();
+
+        // check if both still run, pids may have been reused
+        bool serverRunning = AdoptedProcess::isRunning(serverPid, state.value("ServerStartTime").toULongLong());
+        bool sessionRunning = AdoptedProcess::isRunning(sessionPid, state.value("SessionStartTime").toULongLong());
+
+        if (!serverRunning || !sessionRunning) {
+            // log message
+            qWarning() << " DAEMON: Preserved session on display" << m_display << "is gone.";
+
+            // the display server is of no use without its session
+            discard(state);
+
+            // return fail
+            return false;
         }
 
-        // set socket server name
-        m_socketServer->setSocket(m_socket);
+        // take over virtual screen, cookie and auth file
+        m_geometry = state.value("Geometry").toString();
+        m_depth = state.value("Depth", m_depth).toInt();
+        m_cookie = state.value("Cookie").toString();
+        m_authPath = state.value("AuthPath").toString();
+
+        // set display server params
+        m_displayServer->setDisplay(m_display);
+        m_displayServer->setAuthPath(m_authPath);
+
+        // adopt display server and user session
+        if (!m_displayServer->adopt(serverPid) || !m_authenticator->adopt(sessionPid, state.value("User").toString())) {
+            // clean up
+            m_displayServer->detach();
+            return false;
+        }
+
+        // log message
+        qDebug() << " DAEMON: Adopted session of" << sessionUser() << "on display" << m_display;
 
-        // start socket server
-        m_socketServer->start();
+        // start uptime timer
+        m_uptime.start();
+        m_lastActive.start();
+
+        // set state
+        setState(SessionRunning);
+
+        // an adopted session is on screen already
+        daemonApp->serviceNotifier()->ready();
+
+        // return success
+        return true;
+    }
+
+    void Display::discard(const QVariantMap &state) {
+        qint64 serverPid = state.value("ServerPid").toLongLong();
+
+        // stop the display server unless the pid has been reused
+        if (AdoptedProcess::isRunning(serverPid, state.value("ServerStartTime").toULongLong())) {
+            qDebug() << " DAEMON: Stopping stale display server" << serverPid << "on display :" << state.value("DisplayId").toInt();
+            ::kill(serverPid, SIGTERM);
+        }
+
+        // remove authority file
+        QFile::remove(state.value("AuthPath").toString());
+    }
+
+    QVariantMap Display::runtimeState() const {
+        QVariantMap state;
+
+        // nothing to record without a display server
+        if (m_state == Stopped || serverPid() <= 0)
+            return state;
+
+        // a stale display server is stopped with this
+        state["DisplayId"] = m_displayId;
+        state["TerminalId"] = m_terminalId;
+        state["AuthPath"] = m_authPath;
+        state["ServerPid"] = serverPid();
+        state["ServerStartTime"] = AdoptedProcess::startTime(serverPid());
+
+        // only running sessions can be adopted
+        if (m_state != SessionRunning)
+            return state;
+
+        // save everything needed to adopt the session again
+        state["Geometry"] = m_geometry;
+        state["Depth"] = m_depth;
+        state["Cookie"] = m_cookie;
+        state["User"] = sessionUser();
+        state["SessionPid"] = sessionPid();
+        state["SessionStartTime"] = AdoptedProcess::startTime(sessionPid());
+
+        // return state
+        return state;
+    }
 
-        // set greeter params
+    QVariantMap Display::detach() {
+        // only running sessions are preserved
+        if (m_state != SessionRunning)
+            return QVariantMap();
+
+        // save everything needed to adopt the session again
+        QVariantMap state = runtimeState();
+
+        // leave the processes and the auth file alone
+        m_authenticator->detach();
+        m_displayServer->detach();
+        m_detached = true;
+
+        // log message
+        qDebug() << " DAEMON: Preserving session of" << state["User"].toString() << "on display" << m_display;
+
+        // set state
+        setState(Stopped);
+
+        // return state
+        return state;
+    }
+
+    void Display::displayServerStarted() {
+        // check state
+        if (m_state != StartingServer)
+            return;
+
+        // set state
+        setState(ServerReady);
+
+        // start greeter
+        startGreeter();
+    }
+
+    void Display::startGreeter() {
+        if ((daemonApp->configuration()->first || daemonApp->configuration()->autoRelogin()) &&
+            !daemonApp->configuration()->autoUser().isEmpty() && !daemonApp->configuration()->lastSession().isEmpty()) {
+            // reset first flag
+            daemonApp->configuration()->first = false;
+
+            // start session, show the greeter if that fails
+            if (m_authenticator->start(daemonApp->configuration()->autoUser(), daemonApp->configuration()->lastSession())) {
+                setState(Authenticating);
+                return;
+            }
+        }
+
+        // set greeter params, a fresh token identifies the greeter to the socket server
         m_greeter->setDisplay(m_display);
         m_greeter->setAuthPath(m_authPath);
-        m_greeter->setSocket(m_socket);
+        m_greeter->setSocket(daemonApp->socketServer()->socket());
+        m_greeter->setToken(daemonApp->socketServer()->addDisplay(this));
         m_greeter->setTheme(QString("%1/%2").arg(daemonApp->configuration()->themesDir()).arg(daemonApp->configuration()->currentTheme()));
 
-        // start greeter
-        m_greeter->start();
-
         // reset first flag
         daemonApp->configuration()->first = false;
 
-        // set flags
-        m_started = true;
+        // set state, crashes are handled from here on
+        setState(GreeterUp);
+
+        // start greeter
+        if (!m_greeter->start())
+            fail("Failed to start the greeter");
+    }
+
+    void Display::stopGreeter() {
+        // no restart pending
+        m_greeterRestartTimer->stop();
+
+        // stop the greeter
+        m_greeter->stop();
+
+        // drop the token of the greeter
+        daemonApp->socketServer()->removeDisplay(this);
     }
 
     void Display::stop() {
-        // check flag
-        if (!m_started)
+        // check state
+        if (m_state == Stopped || m_state == TearingDown)
             return;
 
-        // stop user session
-        m_authenticator->blockSignals(true);
+        // set state
+        setState(TearingDown);
+
+        // signal every child at once
+        stopGreeter();
         m_authenticator->stop();
-        m_authenticator->blockSignals(false);
+        m_displayServer->stop();
 
-        // stop the greeter
-        m_greeter->stop();
+        // finish if nothing was running
+        checkStopped();
+    }
 
-        // stop socket server
-        m_socketServer->stop();
+    void Display::checkStopped() {
+        // wait until user session and display server ended
+        if (m_authenticator->isStarted() || m_displayServer->isStarted())
+            return;
 
-        // stop display server
-        m_displayServer->blockSignals(true);
-        m_displayServer->stop();
-        m_displayServer->blockSignals(false);
+        // finish
+        finishStop();
+    }
 
+    void Display::finishStop() {
         // remove authority file
         QFile::remove(m_authPath);
 
-        // reset flag
-        m_started = false;
+        // set state
+        setState(Stopped);
 
         // emit signal
         emit stopped();
     }
 
+    void Display::fail(const QString &reason) {
+        // log message
+        qCritical() << " DAEMON: Display" << m_display << "failed:" << reason;
+
+        // save reason
+        m_failureReason = reason;
+
+        // stop display
+        stop();
+    }
+
+    void Display::displayServerStopped() {
+        // continue stopping
+        if (m_state == TearingDown) {
+            checkStopped();
+            return;
+        }
+
+        // display server ended on its own
+        if (m_state == StartingServer)
+            fail("Display server failed to start");
+        else
+            fail("Display server stopped unexpectedly");
+    }
+
+    void Display::greeterFailed() {
+        // check state
+        if (m_state != GreeterUp)
+            return;
+
+        // count crash
+        m_greeterCrashes++;
+
+        // log message
+        qWarning() << " DAEMON: Greeter crashed on display" << m_display << "(" << m_greeterCrashes << "crashes since last login)";
+
+        // export the counter
+        emit stateChanged();
+
+        // give up when the fallback theme crashes too
+        if (m_greeterCrashes >= 2 * GREETER_CRASH_LIMIT) {
+            fail("Greeter stopped unexpectedly");
+            return;
+        }
+
+        // switch to the fallback theme
+        if (m_greeterCrashes == GREETER_CRASH_LIMIT && !daemonApp->configuration()->fallbackTheme().isEmpty()) {
+            // log message
+            qWarning() << " DAEMON: Switching to fallback theme" << daemonApp->configuration()->fallbackTheme();
+
+            // set theme
+            m_greeter->setTheme(QString("%1/%2").arg(daemonApp->configuration()->themesDir()).arg(daemonApp->configuration()->fallbackTheme()));
+        }
+
+        // get delay, a theme that crashes at startup must not spin
+        int delay = Seat::restartDelay(m_greeterCrashes);
+
+        // log message
+        qWarning() << " DAEMON: Restarting greeter in" << delay << "ms.";
+
+        // restart greeter later
+        m_greeterRestartTimer->start(delay);
+    }
+
+    void Display::restartGreeter() {
+        // check state
+        if (m_state != GreeterUp)
+            return;
+
+        // restart greeter on the same display server and socket
+        if (!m_greeter->start())
+            fail("Failed to restart the greeter");
+    }
+
+    void Display::greeterReady() {
+        // record the files used by the greeter and the display server
+        daemonApp->readahead()->record({ m_greeter->pid(), m_displayServer->pid() });
+    }
+
+    void Display::sessionStarted() {
+        // check state
+        if (m_state != Authenticating)
+            return;
+
+        // set state
+        setState(SessionRunning);
+
+        // an autologin session counts as ready too
+        daemonApp->serviceNotifier()->ready();
+    }
+
+    void Display::sessionStopped() {
+        // continue stopping
+        if (m_state == TearingDown) {
+            checkStopped();
+            return;
+        }
+
+        // restart everything if the display server should not be reused
+        if (!daemonApp->configuration()->reuseDisplayServer()) {
+            stop();
+            return;
+        }
+
+        // log message
+        qDebug() << " DAEMON: Resetting display" << m_display << "...";
+
+        // set state
+        setState(StartingServer);
+
+        // keep the old cookie to trigger the server reset
+        QString cookie = m_cookie;
+
+        // replace the cookie in the auth file
+        generateCookie();
+        addCookie(m_authPath);
+
+        // stop the greeter, its connection still uses the old cookie
+        stopGreeter();
+
+        // xephyr runs without access control in test mode
+        if (daemonApp->configuration()->testing) {
+            displayServerStarted();
+            return;
+        }
+
+        // reset display server, the greeter follows when it is ready
+        if (!m_displayServer->reset(cookie))
+            fail("Failed to reset the display server");
+    }
+
     void Display::login(QLocalSocket *socket, const QString &user, const QString &password, const QString &session) {
+        // check state
+        if (m_state != GreeterUp)
+            return;
+
+        // set state
+        setState(Authenticating);
+
         // start session
         if (!m_authenticator->start(user, password, session)) {
+            // set state
+            if (m_state == Authenticating)
+                setState(GreeterUp);
+
             // emit signal
             emit loginFailed(socket);
 
@@ -245,6 +706,9 @@ namespace SDDM {
             return;
         }
 
+        // reset crash counter
+        m_greeterCrashes = 0;
+
         // save last user and last session
         daemonApp->configuration()->setLastUser(user);
         daemonApp->configuration()->setLastSession(session);
@@ -252,5 +716,8 @@ namespace SDDM {
 
         // emit signal
         emit loginSucceeded(socket);
+
+        // the greeter is not needed while the session runs
+        stopGreeter();
     }
 }
@@ -20,21 +20,34 @@
 #ifndef SDDM_DISPLAY_H
 #define SDDM_DISPLAY_H
 
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QObject>
+#include <QVariantMap>
 
 class QLocalSocket;
+class QTimer;
 
 namespace SDDM {
     class Authenticator;
     class DisplayServer;
     class Seat;
-    class SocketServer;
     class Greeter;
 
     class Display : public QObject {
         Q_OBJECT
         Q_DISABLE_COPY(Display)
     public:
+        enum State {
+            Stopped,
+            StartingServer,
+            ServerReady,
+            GreeterUp,
+            Authenticating,
+            SessionRunning,
+            TearingDown
+        };
+
         explicit Display(const int displayId, const int terminalId, Seat *parent);
         ~Display();
 
@@ -48,35 +61,92 @@ namespace SDDM {
 
         Seat *seat() const;
 
+        bool isVirtual() const;
+        const QString &geometry() const;
+        int depth() const;
+        void setVirtual(const QString &geometry, int depth);
+
+        qulonglong memoryUsage() const;
+        qulonglong cpuTime() const;
+
+        State state() const;
+
+        QString sessionUser() const;
+        qint64 sessionPid() const;
+
+        qint64 greeterPid() const;
+        qint64 serverPid() const;
+        const QDateTime &lastTransition() const;
+        static QString stateName(State state);
+
+        const QString &failureReason() const;
+        qint64 uptime() const;
+
+        void markActive();
+        qint64 inactiveTime() const;
+        int greeterCrashes() const;
+
+        bool adopt(const QVariantMap &state);
+        QVariantMap detach();
+        QVariantMap runtimeState() const;
+        static void discard(const QVariantMap &state);
+
     public slots:
         void start();
         void stop();
 
         void login(QLocalSocket *socket, const QString &user, const QString &password, const QString &session);
+        void greeterReady();
+
+    private slots:
+        void displayServerStarted();
+        void displayServerStopped();
+        void greeterFailed();
+        void restartGreeter();
+        void sessionStarted();
+        void sessionStopped();
 
     signals:
+        void stateChanged();
         void stopped();
 
         void loginFailed(QLocalSocket *socket);
         void loginSucceeded(QLocalSocket *socket);
 
     private:
-        bool m_relogin { true };
-        bool m_started { false };
+        void setState(State state);
+        void generateCookie();
+        void startGreeter();
+        void stopGreeter();
+        void checkStopped();
+        void finishStop();
+        void fail(const QString &reason);
+
+        State m_state { Stopped };
 
         int m_displayId { 0 };
         int m_terminalId { 7 };
+        int m_greeterCrashes { 0 };
+
+        bool m_detached { false };
 
         QString m_display { ":0" };
         QString m_cookie { "" };
-        QString m_socket { "" };
         QString m_authPath { "" };
+        QString m_failureReason { "" };
+
+        QString m_geometry { "" };
+        int m_depth { 24 };
+
+        QElapsedTimer m_uptime;
+        QElapsedTimer m_lastActive;
+        QDateTime m_lastTransition;
 
         Authenticator *m_authenticator { nullptr };
         DisplayServer *m_displayServer { nullptr };
         Seat *m_seat { nullptr };
-        SocketServer *m_socketServer { nullptr };
         Greeter *m_greeter { nullptr };
+        QTimer *m_greeterRestartTimer { nullptr };
     };
 }
 
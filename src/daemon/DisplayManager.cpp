@@ -21,26 +21,54 @@
 
 #include "Configuration.h"
 #include "DaemonApp.h"
+#include "Display.h"
+#include "Seat.h"
 #include "SeatManager.h"
+#include "ServiceNotifier.h"
 
+#include "displayadaptor.h"
 #include "displaymanageradaptor.h"
 #include "seatadaptor.h"
 #include "sessionadaptor.h"
 
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusError>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDebug>
+#include <QRegExp>
+#include <QTimer>
+
 #define DISPLAYMANAGER_SERVICE      QLatin1String("org.freedesktop.DisplayManager")
 #define DISPLAYMANAGER_PATH         QLatin1String("/org/freedesktop/DisplayManager")
 #define DISPLAYMANAGER_SEAT_PATH    QLatin1String("/org/freedesktop/DisplayManager/Seat")
 #define DISPLAYMANAGER_SESSION_PATH QLatin1String("/org/freedesktop/DisplayManager/Session")
+#define DISPLAYMANAGER_DISPLAY_PATH QLatin1String("/org/freedesktop/DisplayManager/Display")
+#define DISPLAYMANAGER_DISPLAY_OBJECT QLatin1String("org.freedesktop.DisplayManager.Display")
+
+#define MAX_SCREEN_SIZE             16384
 
 namespace SDDM {
+    QDBusConnection displayManagerBus() {
+        return (daemonApp->configuration()->testing) ? QDBusConnection::sessionBus() : QDBusConnection::systemBus();
+    }
+
     DisplayManager::DisplayManager(QObject *parent) : QObject(parent) {
+        // register types
+        qDBusRegisterMetaType<SeatSessionMap>();
+
         // create adaptor
         new DisplayManagerAdaptor(this);
+    }
 
+    void DisplayManager::initialize() {
         // register object
-        QDBusConnection connection = (daemonApp->configuration()->testing) ? QDBusConnection::sessionBus() : QDBusConnection::systemBus();
-        connection.registerService(DISPLAYMANAGER_SERVICE);
+        QDBusConnection connection = displayManagerBus();
         connection.registerObject(DISPLAYMANAGER_PATH, this);
+
+        // claim the service name once, without waiting for the reply
+        connection.interface()->asyncCall(QLatin1String("RequestName"), DISPLAYMANAGER_SERVICE, uint(0));
     }
 
     QString DisplayManager::seatPath(const QString &seatName) {
@@ -51,6 +79,18 @@ namespace SDDM {
         return DISPLAYMANAGER_SESSION_PATH + sessionName.mid(7);
     }
 
+    QString DisplayManager::displayPath(const QString &displayName) {
+        return DISPLAYMANAGER_DISPLAY_PATH + displayName.mid(1);
+    }
+
+    DisplayManagerSeat *DisplayManager::seat(const QString &name) const {
+        return m_seats.value(name, nullptr);
+    }
+
+    DisplayManagerSession *DisplayManager::session(const QString &name) const {
+        return m_sessions.value(name, nullptr);
+    }
+
     ObjectPathList DisplayManager::Seats() const {
         ObjectPathList seats;
 
@@ -63,70 +103,244 @@ namespace SDDM {
     ObjectPathList DisplayManager::Sessions(DisplayManagerSeat *seat) const {
         ObjectPathList sessions;
 
-        for (DisplayManagerSession *session: m_sessions)
-            if (seat == nullptr || seat->Name() == session->Seat())
+        // all sessions
+        if (seat == nullptr) {
+            for (DisplayManagerSession *session: m_sessions)
                 sessions << ObjectPath(session->Path());
 
+            return sessions;
+        }
+
+        // sessions of the seat
+        for (const QString &name: m_seatSessions.value(seat->Name()))
+            sessions << ObjectPath(m_sessions[name]->Path());
+
         return sessions;
     }
 
+    ObjectPathList DisplayManager::Displays() const {
+        ObjectPathList displays;
+
+        for (DisplayManagerDisplay *display: m_displays)
+            displays << ObjectPath(display->Path());
+
+        return displays;
+    }
+
+    SeatSessionMap DisplayManager::GetSessionTree() const {
+        SeatSessionMap tree;
+
+        for (DisplayManagerSeat *seat: m_seats)
+            tree.insert(seat->Path(), Sessions(seat));
+
+        return tree;
+    }
+
+    ObjectPath DisplayManager::CreateDisplay(const QString &geometry, int depth) {
+        // check parameters
+        QRegExp size("(\\d+)x(\\d+)");
+        if (!size.exactMatch(geometry) || size.cap(1).toInt() < 1 || size.cap(1).toInt() > MAX_SCREEN_SIZE ||
+            size.cap(2).toInt() < 1 || size.cap(2).toInt() > MAX_SCREEN_SIZE || !QList<int>({ 8, 16, 24, 32 }).contains(depth)) {
+            qWarning() << " DAEMON: Invalid virtual display geometry" << geometry << "depth" << depth;
+            if (calledFromDBus())
+                sendErrorReply(QDBusError::InvalidArgs, QString("Invalid geometry %1 or depth %2").arg(geometry).arg(depth));
+            return ObjectPath();
+        }
+
+        // create display
+        Display *display = daemonApp->seatManager()->createVirtualDisplay(geometry, depth);
+        if (display == nullptr) {
+            if (calledFromDBus() && daemonApp->serviceNotifier()->isStopping())
+                sendErrorReply(QDBusError::Failed, "The display manager is shutting down");
+            else if (calledFromDBus())
+                sendErrorReply(QDBusError::LimitsExceeded, "Virtual display limit reached");
+            return ObjectPath();
+        }
+
+        // register now, so the caller can use the path right away
+        registerObjects();
+
+        // return path
+        return ObjectPath(displayPath(display->name()));
+    }
+
+    void DisplayManager::DestroyDisplay(const ObjectPath &path) {
+        for (DisplayManagerDisplay *object: m_displays) {
+            if (object->Path() != path.path())
+                continue;
+
+            // only virtual displays are created and destroyed on request
+            Display *display = object->display();
+            if (display != nullptr && display->seat()->isVirtual())
+                display->seat()->removeDisplay(display->displayId());
+            else if (calledFromDBus())
+                sendErrorReply(QDBusError::AccessDenied, QString("Display %1 is not a virtual display").arg(path.path()));
+
+            return;
+        }
+
+        // not found
+        if (calledFromDBus())
+            sendErrorReply(QDBusError::InvalidArgs, QString("No such display: %1").arg(path.path()));
+    }
+
     void DisplayManager::AddSeat(const QString &name) {
+        // check if seat exists
+        if (m_seats.contains(name))
+            return;
+
         // create seat object
         DisplayManagerSeat *seat = new DisplayManagerSeat(name, this);
 
-        // add to the list
-        m_seats << seat;
+        // add to the registry
+        m_seats.insert(name, seat);
 
-        // emit signal
-        emit SeatAdded(ObjectPath(seat->Path()));
+        // register object, SeatAdded follows
+        registerObject(seat->Path(), seat);
     }
 
     void DisplayManager::RemoveSeat(const QString &name) {
-        // find seat
-        for (DisplayManagerSeat *seat: m_seats) {
-            if (seat->Name() == name) {
-                // remove from list
-                m_seats.removeAll(seat);
+        // check if seat exists
+        if (!m_seats.contains(name))
+            return;
 
-                // get object path
-                ObjectPath path = ObjectPath(seat->Path());
+        // remove from the registry
+        DisplayManagerSeat *seat = m_seats.take(name);
 
-                // delete seat
-                seat->deleteLater();
+        // get object path
+        ObjectPath path = ObjectPath(seat->Path());
 
-                // emit signal
-                emit SeatRemoved(path);
-            }
-        }
+        // delete seat
+        seat->deleteLater();
+
+        // emit signal if clients knew about it
+        if (unregisterObject(path.path()))
+            emit SeatRemoved(path);
     }
 
     void DisplayManager::AddSession(const QString &name, const QString &seat, const QString &user) {
+        // check if session exists
+        if (m_sessions.contains(name))
+            return;
+
         // create session object
         DisplayManagerSession *session = new DisplayManagerSession(name, seat, user, this);
 
-        // add to the list
-        m_sessions << session;
+        // add to the registry
+        m_sessions.insert(name, session);
+        m_seatSessions[seat].insert(name);
 
-        // emit signal
-        emit SessionAdded(ObjectPath(session->Path()));
+        // register object, SessionAdded follows
+        registerObject(session->Path(), session);
     }
 
     void DisplayManager::RemoveSession(const QString &name) {
-        // find session
-        for (DisplayManagerSession *session: m_sessions) {
-            if (session->Name() == name) {
-                // remove from list
-                m_sessions.removeAll(session);
+        // check if session exists
+        if (!m_sessions.contains(name))
+            return;
+
+        // remove from the registry
+        DisplayManagerSession *session = m_sessions.take(name);
+        m_seatSessions[session->Seat()].remove(name);
+        if (m_seatSessions[session->Seat()].isEmpty())
+            m_seatSessions.remove(session->Seat());
+
+        // get object path
+        ObjectPath path = ObjectPath(session->Path());
+
+        // delete session
+        session->deleteLater();
+
+        // emit signal if clients knew about it
+        if (unregisterObject(path.path()))
+            emit SessionRemoved(path);
+    }
+
+    void DisplayManager::AddDisplay(Display *display) {
+        // check if display exists
+        if (m_displays.contains(display->name()))
+            return;
 
-                // get object path
-                ObjectPath path = ObjectPath(session->Path());
+        // create display object
+        DisplayManagerDisplay *object = new DisplayManagerDisplay(display, this);
 
-                // delete session
-                session->deleteLater();
+        // add to the registry
+        m_displays.insert(display->name(), object);
 
-                // emit signal
-                emit SessionRemoved(path);
-            }
+        // register object, DisplayAdded follows
+        registerObject(object->Path(), object);
+    }
+
+    void DisplayManager::RemoveDisplay(const QString &name) {
+        // check if display exists
+        if (!m_displays.contains(name))
+            return;
+
+        // remove from the registry
+        DisplayManagerDisplay *display = m_displays.take(name);
+
+        // get object path
+        ObjectPath path = ObjectPath(display->Path());
+
+        // delete display
+        display->deleteLater();
+
+        // emit signal if clients knew about it
+        if (unregisterObject(path.path()))
+            emit DisplayRemoved(path);
+    }
+
+    void DisplayManager::registerObject(const QString &path, QObject *object) {
+        // add to the registry
+        m_objects.insert(path, object);
+
+        // schedule registration, objects added in one go are registered together
+        if (m_pendingPaths.isEmpty())
+            QTimer::singleShot(0, this, SLOT(registerObjects()));
+
+        // add to the queue
+        m_pendingPaths << path;
+    }
+
+    bool DisplayManager::unregisterObject(const QString &path) {
+        // remove from the registry
+        m_objects.remove(path);
+
+        // not registered yet, nobody saw it
+        if (m_pendingPaths.removeAll(path) > 0)
+            return false;
+
+        // unregister object
+        displayManagerBus().unregisterObject(path);
+
+        // return success
+        return true;
+    }
+
+    void DisplayManager::registerObjects() {
+        QDBusConnection connection = displayManagerBus();
+
+        // take the queue
+        QList<QString> paths = m_pendingPaths;
+        m_pendingPaths.clear();
+
+        for (const QString &path: paths) {
+            QObject *object = m_objects.value(path, nullptr);
+
+            // check object
+            if (object == nullptr)
+                continue;
+
+            // register object
+            connection.registerObject(path, object);
+
+            // announce it, clients can introspect it right away
+            if (qobject_cast<DisplayManagerSeat *>(object))
+                emit SeatAdded(ObjectPath(path));
+            else if (qobject_cast<DisplayManagerDisplay *>(object))
+                emit DisplayAdded(ObjectPath(path));
+            else
+                emit SessionAdded(ObjectPath(path));
         }
     }
 
@@ -135,13 +349,8 @@ namespace SDDM {
         m_name = name;
         m_path = DISPLAYMANAGER_SEAT_PATH + name.mid(4);
 
-        // create adaptor
+        // create adaptor, the display manager registers the object
         new SeatAdaptor(this);
-
-        // register object
-        QDBusConnection connection = (daemonApp->configuration()->testing) ? QDBusConnection::sessionBus() : QDBusConnection::systemBus();
-        connection.registerService(DISPLAYMANAGER_SERVICE);
-        connection.registerObject(m_path, this);
     }
 
     const QString &DisplayManagerSeat::Name() const {
@@ -157,11 +366,12 @@ namespace SDDM {
     }
 
     void DisplayManagerSeat::SwitchToGuest(const QString &/*session*/) {
-        // TODO: IMPLEMENT
+        // there are no guest accounts, let the guest use the greeter
+        daemonApp->seatManager()->switchToGreeter(m_name);
     }
 
-    void DisplayManagerSeat::SwitchToUser(const QString &/*user*/, const QString &/*session*/) {
-        // TODO: IMPLEMENT
+    void DisplayManagerSeat::SwitchToUser(const QString &user, const QString &/*session*/) {
+        daemonApp->seatManager()->switchToUser(m_name, user);
     }
 
     void DisplayManagerSeat::Lock() {
@@ -172,17 +382,18 @@ namespace SDDM {
        return daemonApp->displayManager()->Sessions(this);
     }
 
+    QString DisplayManagerSeat::FailureReason() const {
+        Seat *seat = daemonApp->seatManager()->seat(m_name);
+
+        return (seat != nullptr) ? seat->failureReason() : QString();
+    }
+
     DisplayManagerSession::DisplayManagerSession(const QString &name, const QString &seat, const QString &user, QObject *parent) : QObject(parent), m_name(name), m_seat(seat), m_user(user) {
         // set path
         m_path = DISPLAYMANAGER_SESSION_PATH + name.mid(7);
 
-        // create adaptor
+        // create adaptor, the display manager registers the object
         new SessionAdaptor(this);
-
-        // register object
-        QDBusConnection connection = (daemonApp->configuration()->testing) ? QDBusConnection::sessionBus() : QDBusConnection::systemBus();
-        connection.registerService(DISPLAYMANAGER_SERVICE);
-        connection.registerObject(m_path, this);
     }
 
     const QString &DisplayManagerSession::Name() const {
@@ -202,10 +413,116 @@ namespace SDDM {
     }
 
     ObjectPath DisplayManagerSession::SeatPath() const {
-        return ObjectPath(DISPLAYMANAGER_SEAT_PATH + m_seat.mid(4));
+        return ObjectPath(daemonApp->displayManager()->seatPath(m_seat));
     }
 
     const QString &DisplayManagerSession::User() const {
         return m_user;
     }
+
+    DisplayManagerDisplay::DisplayManagerDisplay(Display *display, QObject *parent) : QObject(parent), m_display(display) {
+        // set name and path
+        m_name = display->name();
+        m_path = DISPLAYMANAGER_DISPLAY_PATH + m_name.mid(1);
+
+        // remember what clients have seen
+        m_properties = properties();
+
+        // push changes to clients
+        connect(display, SIGNAL(stateChanged()), this, SLOT(displayChanged()));
+
+        // create adaptor, the display manager registers the object
+        new DisplayAdaptor(this);
+    }
+
+    const QString &DisplayManagerDisplay::Name() const {
+        return m_name;
+    }
+
+    const QString &DisplayManagerDisplay::Path() const {
+        return m_path;
+    }
+
+    Display *DisplayManagerDisplay::display() const {
+        return m_display;
+    }
+
+    ObjectPath DisplayManagerDisplay::SeatPath() const {
+        return ObjectPath(m_display ? daemonApp->displayManager()->seatPath(m_display->seat()->name()) : QString("/"));
+    }
+
+    int DisplayManagerDisplay::VT() const {
+        return m_display ? m_display->terminalId() : 0;
+    }
+
+    QString DisplayManagerDisplay::State() const {
+        return Display::stateName(m_display ? m_display->state() : Display::Stopped);
+    }
+
+    qlonglong DisplayManagerDisplay::GreeterPid() const {
+        return m_display ? m_display->greeterPid() : 0;
+    }
+
+    qlonglong DisplayManagerDisplay::ServerPid() const {
+        return m_display ? m_display->serverPid() : 0;
+    }
+
+    qulonglong DisplayManagerDisplay::LastTransition() const {
+        return m_display ? m_display->lastTransition().toMSecsSinceEpoch() : 0;
+    }
+
+    QString DisplayManagerDisplay::Geometry() const {
+        return m_display ? m_display->geometry() : QString();
+    }
+
+    int DisplayManagerDisplay::Depth() const {
+        return m_display ? m_display->depth() : 0;
+    }
+
+    qulonglong DisplayManagerDisplay::MemoryUsage() const {
+        return m_display ? m_display->memoryUsage() : 0;
+    }
+
+    qulonglong DisplayManagerDisplay::CpuTime() const {
+        return m_display ? m_display->cpuTime() : 0;
+    }
+
+    int DisplayManagerDisplay::GreeterCrashes() const {
+        return m_display ? m_display->greeterCrashes() : 0;
+    }
+
+    QVariantMap DisplayManagerDisplay::properties() const {
+        QVariantMap properties;
+
+        properties.insert("State", State());
+        properties.insert("GreeterPid", GreeterPid());
+        properties.insert("ServerPid", ServerPid());
+        properties.insert("LastTransition", LastTransition());
+        properties.insert("GreeterCrashes", GreeterCrashes());
+
+        return properties;
+    }
+
+    void DisplayManagerDisplay::displayChanged() {
+        // get current values
+        QVariantMap current = properties();
+
+        // collect what changed since the last signal
+        QVariantMap changed;
+        for (auto it = current.constBegin(); it != current.constEnd(); ++it)
+            if (m_properties.value(it.key()) != it.value())
+                changed.insert(it.key(), it.value());
+
+        // nothing to tell
+        if (changed.isEmpty())
+            return;
+
+        // remember what clients have seen
+        m_properties = current;
+
+        // emit signal
+        QDBusMessage message = QDBusMessage::createSignal(m_path, QLatin1String("org.freedesktop.DBus.Properties"), QLatin1String("PropertiesChanged"));
+        message << DISPLAYMANAGER_DISPLAY_OBJECT << changed << QStringList();
+        displayManagerBus().send(message);
+    }
 }
@@ -22,48 +22,85 @@
 
 #include <QObject>
 
+#include <QDBusContext>
 #include <QDBusObjectPath>
+#include <QHash>
 #include <QList>
+#include <QMap>
+#include <QPointer>
+#include <QSet>
+#include <QVariantMap>
 
 namespace SDDM {
+    class Display;
+    class DisplayManagerDisplay;
     class DisplayManagerSeat;
     class DisplayManagerSession;
 
     typedef QDBusObjectPath ObjectPath;
     typedef QList<QDBusObjectPath> ObjectPathList;
+    typedef QMap<QString, ObjectPathList> SeatSessionMap;
 
     /***************************************************************************
      * org.freedesktop.DisplayManager
      **************************************************************************/
-    class DisplayManager : public QObject {
+    class DisplayManager : public QObject, protected QDBusContext {
         Q_OBJECT
         Q_DISABLE_COPY(DisplayManager)
         Q_PROPERTY(QList<QDBusObjectPath> Seats READ Seats CONSTANT)
         Q_PROPERTY(QList<QDBusObjectPath> Sessions READ Sessions CONSTANT)
+        Q_PROPERTY(QList<QDBusObjectPath> Displays READ Displays CONSTANT)
     public:
         DisplayManager(QObject *parent = 0);
 
         QString seatPath(const QString &seatName);
         QString sessionPath(const QString &sessionName);
+        QString displayPath(const QString &displayName);
+
+        DisplayManagerSeat *seat(const QString &name) const;
+        DisplayManagerSession *session(const QString &name) const;
 
         ObjectPathList Seats() const;
         ObjectPathList Sessions(DisplayManagerSeat *seat = nullptr) const;
+        ObjectPathList Displays() const;
+
+        SeatSessionMap GetSessionTree() const;
+
+        ObjectPath CreateDisplay(const QString &geometry, int depth);
+        void DestroyDisplay(const ObjectPath &display);
 
     public slots:
+        void initialize();
+
         void AddSeat(const QString &name);
         void RemoveSeat(const QString &name);
         void AddSession(const QString &name, const QString &seat, const QString &user);
         void RemoveSession(const QString &name);
+        void AddDisplay(Display *display);
+        void RemoveDisplay(const QString &name);
 
     signals:
         void SeatAdded(ObjectPath seat);
         void SeatRemoved(ObjectPath seat);
         void SessionAdded(ObjectPath session);
         void SessionRemoved(ObjectPath session);
+        void DisplayAdded(ObjectPath display);
+        void DisplayRemoved(ObjectPath display);
+
+    private slots:
+        void registerObjects();
 
     private:
-        QList<DisplayManagerSeat *> m_seats;
-        QList<DisplayManagerSession *> m_sessions;
+        void registerObject(const QString &path, QObject *object);
+        bool unregisterObject(const QString &path);
+
+        QHash<QString, DisplayManagerSeat *> m_seats;
+        QHash<QString, DisplayManagerSession *> m_sessions;
+        QHash<QString, QSet<QString>> m_seatSessions;
+        QHash<QString, DisplayManagerDisplay *> m_displays;
+
+        QHash<QString, QObject *> m_objects;
+        QList<QString> m_pendingPaths;
     };
 
     /***************************************************************************
@@ -75,6 +112,7 @@ namespace SDDM {
         Q_PROPERTY(bool CanSwitch READ CanSwitch CONSTANT)
         Q_PROPERTY(bool HasGuestAccount READ HasGuestAccount CONSTANT)
         Q_PROPERTY(QList<QDBusObjectPath> Sessions READ Sessions CONSTANT)
+        Q_PROPERTY(QString FailureReason READ FailureReason)
     public:
         DisplayManagerSeat(const QString &name, QObject *parent = 0);
 
@@ -89,6 +127,7 @@ namespace SDDM {
         bool CanSwitch() { return true; }
         bool HasGuestAccount() { return false; }
         ObjectPathList Sessions();
+        QString FailureReason() const;
 
     private:
         QString m_name { "" };
@@ -121,6 +160,60 @@ namespace SDDM {
         QString m_seat { "" };
         QString m_user { "" };
     };
+
+    /***************************************************************************
+     * org.freedesktop.DisplayManager.Display
+     **************************************************************************/
+    class DisplayManagerDisplay: public QObject {
+        Q_OBJECT
+        Q_DISABLE_COPY(DisplayManagerDisplay)
+        Q_PROPERTY(QString Name READ Name CONSTANT)
+        Q_PROPERTY(QDBusObjectPath Seat READ SeatPath CONSTANT)
+        Q_PROPERTY(int VT READ VT CONSTANT)
+        Q_PROPERTY(QString State READ State)
+        Q_PROPERTY(qlonglong GreeterPid READ GreeterPid)
+        Q_PROPERTY(qlonglong ServerPid READ ServerPid)
+        Q_PROPERTY(qulonglong LastTransition READ LastTransition)
+        Q_PROPERTY(QString Geometry READ Geometry CONSTANT)
+        Q_PROPERTY(int Depth READ Depth CONSTANT)
+        Q_PROPERTY(qulonglong MemoryUsage READ MemoryUsage)
+        Q_PROPERTY(qulonglong CpuTime READ CpuTime)
+        Q_PROPERTY(int GreeterCrashes READ GreeterCrashes)
+    public:
+        DisplayManagerDisplay(Display *display, QObject *parent = 0);
+
+        const QString &Name() const;
+        const QString &Path() const;
+
+        Display *display() const;
+
+        ObjectPath SeatPath() const;
+        int VT() const;
+        QString State() const;
+        qlonglong GreeterPid() const;
+        qlonglong ServerPid() const;
+        qulonglong LastTransition() const;
+        QString Geometry() const;
+        int Depth() const;
+        qulonglong MemoryUsage() const;
+        qulonglong CpuTime() const;
+        int GreeterCrashes() const;
+
+    private slots:
+        void displayChanged();
+
+    private:
+        QVariantMap properties() const;
+
+        QString m_name { "" };
+        QString m_path { "" };
+
+        QVariantMap m_properties;
+
+        QPointer<Display> m_display;
+    };
 }
 
+Q_DECLARE_METATYPE(SDDM::SeatSessionMap)
+
 #endif // SDDM_DISPLAYMANAGER_H
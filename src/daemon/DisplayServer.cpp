@@ -19,23 +19,283 @@
 
 #include "DisplayServer.h"
 
+#include "AdoptedProcess.h"
+#include "ChildProcess.h"
 #include "Configuration.h"
+#include "Constants.h"
 #include "DaemonApp.h"
 #include "Display.h"
+#include "Seat.h"
 
 #include <QDebug>
-#include <QProcess>
+#include <QFileInfo>
+#include <QTimer>
 
 #include <xcb/xcb.h>
 
-#include <unistd.h>
+#define CONNECT_INTERVAL 100
+#define CONNECT_ATTEMPTS 100
+#define RESET_ATTEMPTS 5
+#define STOP_TIMEOUT 5000
+#define HEADLESS_STOP_TIMEOUT 2000
+
+#define DEFAULT_GEOMETRY "800x600"
+#define DEFAULT_DEPTH 24
+
+#define XEPHYR_PATH "/usr/bin/Xephyr"
+#define XVFB_PATH "/usr/bin/Xvfb"
+#define XVNC_PATH "/usr/bin/Xvnc"
 
 namespace SDDM {
+    /**********************************************/
+    /* DISPLAY SERVER BACKEND                     */
+    /**********************************************/
+
+    class DisplayServerBackend {
+    public:
+        DisplayServerBackend(DisplayServer *server) : m_server(server) {
+        }
+
+        virtual ~DisplayServerBackend() {
+        }
+
+        virtual QString program() const = 0;
+        virtual QStringList arguments() const = 0;
+
+        virtual QProcessEnvironment environment() const {
+            QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+            env.insert("XAUTHORITY", m_server->authPath());
+            return env;
+        }
+
+        // servers that write their display number to -displayfd once they
+        // accept connections, the others are polled until they do
+        virtual bool hasDisplayFd() const {
+            return true;
+        }
+
+        // time a terminated server gets before it is killed
+        virtual int stopTimeout() const {
+            return HEADLESS_STOP_TIMEOUT;
+        }
+
+        static DisplayServerBackend *create(const QString &name, DisplayServer *server);
+
+    protected:
+        QString geometry() const {
+            return m_server->displayPtr()->isVirtual() ? m_server->displayPtr()->geometry() : QString(DEFAULT_GEOMETRY);
+        }
+
+        int depth() const {
+            return m_server->displayPtr()->isVirtual() ? m_server->displayPtr()->depth() : DEFAULT_DEPTH;
+        }
+
+        QString serverPath(const QString &defaultPath) const {
+            // virtual displays run the configured virtual server if it is of this kind
+            QString path = daemonApp->configuration()->virtualServerPath();
+            if (m_server->displayPtr()->isVirtual() && QFileInfo(path).fileName() == QFileInfo(defaultPath).fileName())
+                return path;
+
+            return defaultPath;
+        }
+
+        DisplayServer *m_server { nullptr };
+    };
+
+    /**********************************************/
+    /* XORG BACKEND                               */
+    /**********************************************/
+
+    class XorgBackend : public DisplayServerBackend {
+    public:
+        XorgBackend(DisplayServer *server) : DisplayServerBackend(server) {
+        }
+
+        QString program() const {
+            return daemonApp->configuration()->serverPath();
+        }
+
+        QStringList arguments() const {
+            QStringList args { m_server->display(), "-auth", m_server->authPath(), "-nolisten", "tcp" };
+
+            // seats without virtual terminals only get their own devices
+            Display *display = m_server->displayPtr();
+            if (display->terminalId() > 0)
+                args << QString("vt%1").arg(QString::number(display->terminalId()), 2, '0');
+            if (display->seat()->name() != "seat0")
+                args << "-seat" << display->seat()->name();
+
+            return args;
+        }
+
+        QProcessEnvironment environment() const {
+            QProcessEnvironment env = DisplayServerBackend::environment();
+            env.insert("DISPLAY", m_server->display());
+            env.insert("XCURSOR_THEME", daemonApp->configuration()->cursorTheme());
+            return env;
+        }
+
+        // the server restores the virtual terminal before it exits
+        int stopTimeout() const {
+            return STOP_TIMEOUT;
+        }
+    };
+
+    /**********************************************/
+    /* XVFB BACKEND                               */
+    /**********************************************/
+
+    class XvfbBackend : public DisplayServerBackend {
+    public:
+        XvfbBackend(DisplayServer *server) : DisplayServerBackend(server) {
+        }
+
+        QString program() const {
+            return serverPath(XVFB_PATH);
+        }
+
+        QStringList arguments() const {
+            return { m_server->display(), "-auth", m_server->authPath(), "-nolisten", "tcp",
+                     "-screen", "0", QString("%1x%2").arg(geometry()).arg(depth()) };
+        }
+    };
+
+    /**********************************************/
+    /* XEPHYR BACKEND                             */
+    /**********************************************/
+
+    class XephyrBackend : public DisplayServerBackend {
+    public:
+        XephyrBackend(DisplayServer *server) : DisplayServerBackend(server) {
+        }
+
+        QString program() const {
+            return XEPHYR_PATH;
+        }
+
+        QStringList arguments() const {
+            return { m_server->display(), "-auth", m_server->authPath(), "-nolisten", "tcp",
+                     "-br", "-screen", QString("%1x%2").arg(geometry()).arg(depth()) };
+        }
+    };
+
+    /**********************************************/
+    /* XVNC BACKEND                               */
+    /**********************************************/
+
+    class XvncBackend : public DisplayServerBackend {
+    public:
+        XvncBackend(DisplayServer *server) : DisplayServerBackend(server) {
+        }
+
+        QString program() const {
+            return serverPath(XVNC_PATH);
+        }
+
+        QStringList arguments() const {
+            return { m_server->display(), "-auth", m_server->authPath(), "-nolisten", "tcp",
+                     "-geometry", geometry(), "-depth", QString::number(depth()) };
+        }
+
+        // builds on older server sources do not know -displayfd
+        bool hasDisplayFd() const {
+            return false;
+        }
+    };
+
+    DisplayServerBackend *DisplayServerBackend::create(const QString &name, DisplayServer *server) {
+        if (name == "xvfb")
+            return new XvfbBackend(server);
+        if (name == "xephyr")
+            return new XephyrBackend(server);
+        if (name == "xvnc")
+            return new XvncBackend(server);
+
+        // log message
+        if (name != "xorg")
+            qWarning() << " DAEMON: Unknown display server" << name << "- using xorg.";
+
+        return new XorgBackend(server);
+    }
+
+    /**********************************************/
+    /* DISPLAY SERVER                             */
+    /**********************************************/
+
+    bool tryConnect(const QString &display, const QString &cookie) {
+        // cookie data is stored in binary form
+        QByteArray data = QByteArray::fromHex(cookie.toLatin1());
+
+        // auth object
+        xcb_auth_info_t auth_info { 18, strdup("MIT-MAGIC-COOKIE-1"), data.length(), static_cast<char *>(malloc(data.length())) };
+        memcpy(auth_info.data, data.constData(), data.length());
+
+        // try to connect to the server
+        xcb_connection_t *connection = xcb_connect_to_display_with_auth_info(qPrintable(display), &auth_info, nullptr);
+
+        // xcb returns an error object instead of null on failure
+        bool result = (connection != nullptr) && !xcb_connection_has_error(connection);
+
+        // close connection
+        if (connection != nullptr)
+            xcb_disconnect(connection);
+
+        // free resources
+        free(auth_info.data);
+        free(auth_info.name);
+
+        // return result
+        return result;
+    }
+
     DisplayServer::DisplayServer(Display *parent) : QObject(parent), m_displayPtr(parent) {
+        // create connection timer
+        m_timer = new QTimer(this);
+        m_timer->setInterval(CONNECT_INTERVAL);
+
+        // try to connect on every tick
+        connect(m_timer, SIGNAL(timeout()), this, SLOT(checkConnection()));
     }
 
     DisplayServer::~DisplayServer() {
-        stop();
+        // clean up
+        delete m_backend;
+        m_backend = nullptr;
+
+        // check flag
+        if (!m_started)
+            return;
+
+        // the daemon is exiting and the shutdown deadline passed
+        if (m_adopted) {
+            m_adopted->kill();
+            return;
+        }
+
+        // nobody is listening anymore
+        process->disconnect(this);
+
+        process->kill();
+        process->waitForFinished();
+    }
+
+    bool DisplayServer::isStarted() const {
+        return m_started;
+    }
+
+    qint64 DisplayServer::pid() const {
+        if (m_adopted != nullptr)
+            return m_adopted->pid();
+
+        return (process != nullptr) ? process->pid() : 0;
+    }
+
+    const QString &DisplayServer::display() const {
+        return m_display;
+    }
+
+    const QString &DisplayServer::authPath() const {
+        return m_authPath;
     }
 
     void DisplayServer::setDisplay(const QString &display) {
@@ -51,71 +311,181 @@ namespace SDDM {
         if (m_started)
             return false;
 
+        // pick the backend, virtual displays default to the virtual server
+        Configuration *config = daemonApp->configuration();
+        QString name = config->displayServer(m_displayPtr->seat()->name());
+        if (name.isEmpty() && config->testing)
+            name = "xephyr";
+        else if (name.isEmpty() && m_displayPtr->isVirtual())
+            name = QFileInfo(config->virtualServerPath()).fileName().toLower();
+        else if (name.isEmpty())
+            name = "xorg";
+
+        // create backend
+        delete m_backend;
+        m_backend = DisplayServerBackend::create(name, this);
+
         // create process
-        process = new QProcess(this);
+        process = new ChildProcess(this);
+
+        // a preserved server must not lose its pipes when the daemon exits,
+        // the display number on stdout is the only thing read and the
+        // server ignores SIGPIPE
+        process->setLog(ChildProcess::logSink(config->displayServerLog()), "sddm-display-server",
+                        QString("%1/display%2.log").arg(LOG_DIR).arg(m_display), !m_backend->hasDisplayFd());
+        if (m_backend->hasDisplayFd())
+            connect(process, SIGNAL(readyReadStandardOutput()), this, SLOT(readDisplayFd()));
+
+        // set scheduling, io and oom policy
+        process->setPolicy(config->displayServerPolicy());
 
         // delete process on finish
         connect(process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(finished()));
 
+        // handle processes that could not be started
+        connect(process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(processError(QProcess::ProcessError)));
+
         // log message
-        qDebug() << " DAEMON: Display server starting...";
+        qDebug() << " DAEMON: Display server starting..." << name;
 
-        if (daemonApp->configuration()->testing) {
-            process->start("/usr/bin/Xephyr", { m_display, "-ac", "-br", "-noreset", "-screen",  "800x600"});
-        } else {
-            // set process environment
-            QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
-            env.insert("DISPLAY", m_display);
-            env.insert("XAUTHORITY", m_authPath);
-            env.insert("XCURSOR_THEME", daemonApp->configuration()->cursorTheme());
-            process->setProcessEnvironment(env);
+        // set flags
+        m_started = true;
+        m_stopping = false;
+        m_waitForDisplayFd = m_backend->hasDisplayFd();
 
-            // start display server
-            process->start(daemonApp->configuration()->serverPath(), { m_display, "-auth", m_authPath, "-nolisten", "tcp", QString("vt%1").arg(QString::number(m_displayPtr->terminalId()), 2, '0')});
-        }
+        // set process arguments
+        QStringList args = m_backend->arguments();
+        if (m_waitForDisplayFd)
+            args << "-displayfd" << "1";
 
-        // wait for display server to start
-        if (!process->waitForStarted()) {
-            // log message
-            qCritical() << " DAEMON: Failed to start display server process.";
+        // the test mode runs without access control
+        if (config->testing)
+            args << "-ac" << "-noreset";
 
-            // return fail
+        // start display server
+        process->setProcessEnvironment(m_backend->environment());
+        process->start(m_backend->program(), args);
+
+        // check flag, the process may have failed already
+        if (!m_started)
             return false;
-        }
 
-        // wait until we can connect to the display server
-        if (!this->waitForStarted()) {
-            // log message
-            qCritical() << " DAEMON: Failed to connect to the display server.";
+        // started is emitted when we can connect to the display server
+        waitForConnection();
 
-            // return fail
+        // return success
+        return true;
+    }
+
+    bool DisplayServer::adopt(qint64 pid) {
+        // check flag
+        if (m_started)
+            return false;
+
+        // watch the server a previous daemon started
+        m_adopted = new AdoptedProcess(pid, this);
+
+        // check if it is still there
+        if (!m_adopted->isRunning()) {
+            delete m_adopted;
+            m_adopted = nullptr;
             return false;
         }
 
+        // stopped is emitted on finish
+        connect(m_adopted, SIGNAL(finished()), this, SLOT(finished()));
+
         // log message
-        qDebug() << " DAEMON: Display server started.";
+        qDebug() << " DAEMON: Display server adopted, pid" << pid;
 
-        // set flag
+        // set flags
         m_started = true;
+        m_stopping = false;
 
         // return success
         return true;
     }
 
-    void DisplayServer::stop() {
+    qint64 DisplayServer::detach() {
         // check flag
         if (!m_started)
+            return 0;
+
+        // get pid
+        qint64 result = pid();
+
+        // stop connecting
+        m_timer->stop();
+
+        if (m_adopted) {
+            delete m_adopted;
+            m_adopted = nullptr;
+        } else {
+            // leave the process running, the daemon exits right after this
+            process->disconnect(this);
+            process->setParent(nullptr);
+            process = nullptr;
+        }
+
+        // reset flags
+        m_started = false;
+        m_stopping = false;
+
+        // log message
+        qDebug() << " DAEMON: Display server detached, pid" << result;
+
+        // return pid
+        return result;
+    }
+
+    bool DisplayServer::reset(const QString &cookie) {
+        // check flag
+        if (!m_started || m_stopping)
+            return false;
+
+        // log message
+        qDebug() << " DAEMON: Display server resetting...";
+
+        // the server rereads its authority file when the last client
+        // disconnects, so open and close a connection with the old cookie
+        m_oldCookie = cookie;
+        tryConnect(m_display, m_oldCookie);
+
+        // set flag
+        m_resetting = true;
+
+        // started is emitted when the server accepts the new cookie
+        waitForConnection();
+
+        // return success
+        return true;
+    }
+
+    void DisplayServer::stop() {
+        // a stop on request wins over a pending restart
+        m_restarting = false;
+
+        // check flag
+        if (!m_started || m_stopping)
             return;
 
+        // set flag
+        m_stopping = true;
+
+        // stop connecting
+        m_timer->stop();
+
         // log message
         qDebug() << " DAEMON: Display server stopping...";
 
-        // terminate process
-        process->terminate();
-
-        // wait for finished
-        if (!process->waitForFinished(5000))
-            process->kill();
+        // terminate process, kill it if it does not finish in time, stopped is emitted on finish
+        if (m_adopted) {
+            m_adopted->terminate();
+            QTimer::singleShot(STOP_TIMEOUT, m_adopted, SLOT(kill()));
+        } else {
+            process->terminate();
+            QTimer::singleShot(m_backend->stopTimeout(), process, SLOT(kill()));
+        }
     }
 
     void DisplayServer::finished() {
@@ -123,59 +493,126 @@ namespace SDDM {
         if (!m_started)
             return;
 
-        // reset flag
+        // reset flags
         m_started = false;
+        m_stopping = false;
+        m_waitForDisplayFd = false;
+        m_resetting = false;
+
+        // stop connecting
+        m_timer->stop();
 
         // log message
         qDebug() << " DAEMON: Display server stopped.";
 
         // clean up
-        process->deleteLater();
-        process = nullptr;
+        if (m_adopted) {
+            m_adopted->deleteLater();
+            m_adopted = nullptr;
+        } else {
+            process->deleteLater();
+            process = nullptr;
+        }
+
+        // start a fresh server in place of the one that did not reset,
+        // started is emitted when it is ready, stopped when it fails, even
+        // if that happens right inside start(), so do not emit it here again
+        if (m_restarting) {
+            m_restarting = false;
+            start();
+            return;
+        }
 
         // emit signal
         emit stopped();
     }
 
-    bool DisplayServer::waitForStarted(int msecs) {
-        bool result = false;
+    void DisplayServer::processError(QProcess::ProcessError error) {
+        // only handle processes that never ran, finished covers the rest
+        if (error != QProcess::FailedToStart)
+            return;
 
-        // get cookie from the display
-        QString cookie = m_displayPtr->cookie();
+        // log message
+        qCritical() << " DAEMON: Failed to start display server process.";
 
-        // connection object
-        xcb_connection_t *connection = nullptr;
+        // clean up
+        finished();
+    }
 
-        // auth object
-        xcb_auth_info_t auth_info { 18, strdup("MIT-MAGIC-COOKIE-1"), cookie.length(), strdup(qPrintable(cookie)) };
+    void DisplayServer::waitForConnection() {
+        // reset counter
+        m_attempts = 0;
 
-        // try to connect to the server
-        for (int i = 0; i < (msecs / 100); ++i) {
+        // start trying
+        m_timer->start();
+    }
 
-            // try to connect to the server
-            connection = xcb_connect_to_display_with_auth_info(qPrintable(m_display), &auth_info, nullptr);
+    void DisplayServer::checkConnection() {
+        // return if connected, servers with -displayfd tell us themselves
+        if (!m_waitForDisplayFd && tryConnect(m_display, m_displayPtr->cookie())) {
+            connected();
+            return;
+        }
 
-            // check connection
-            if (connection != nullptr)
-                break;
+        // the old cookie still works, so clients of the last session are
+        // connected and the server will not reset, they must not see the
+        // next greeter, so restart the server instead of waiting
+        if (m_resetting && tryConnect(m_display, m_oldCookie)) {
+            // give the server a moment to process the disconnect
+            if (++m_attempts < RESET_ATTEMPTS)
+                return;
 
-            // sleep for 100 miliseconds
-            usleep(100000);
-        }
+            // log message
+            qWarning() << " DAEMON: Display server still has clients, restarting it.";
 
-        if (connection != nullptr) {
-            // close connection
-            xcb_disconnect(connection);
+            // stop connecting
+            m_timer->stop();
+            m_resetting = false;
 
-            // set success flag
-            result = true;
+            // set flag, the server is started again on finish
+            stop();
+            m_restarting = true;
+
+            // return
+            return;
         }
 
-        // free resources
-        free(auth_info.data);
-        free(auth_info.name);
+        // keep trying
+        if (++m_attempts < CONNECT_ATTEMPTS)
+            return;
 
-        // return result
-        return result;
+        // log message
+        qCritical() << " DAEMON: Failed to connect to the display server.";
+
+        // give up, stopped is emitted when the process ended
+        stop();
+    }
+
+    void DisplayServer::readDisplayFd() {
+        // the server writes its display number once it accepts connections
+        if (!m_waitForDisplayFd || !process->canReadLine())
+            return;
+
+        // drop it, we know the number already
+        process->readAll();
+
+        // reset flag, resets are polled
+        m_waitForDisplayFd = false;
+
+        connected();
+    }
+
+    void DisplayServer::connected() {
+        // stop trying
+        m_timer->stop();
+
+        // reset flag
+        m_resetting = false;
+
+        // log message
+        qDebug() << " DAEMON: Display server started.";
+
+        // emit signal
+        emit started();
     }
 }
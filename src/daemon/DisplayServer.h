@@ -21,11 +21,15 @@
 #define SDDM_DISPLAYSERVER_H
 
 #include <QObject>
+#include <QProcess>
 
-class QProcess;
+class QTimer;
 
 namespace SDDM {
+    class AdoptedProcess;
+    class ChildProcess;
     class Display;
+    class DisplayServerBackend;
 
     class DisplayServer : public QObject {
         Q_OBJECT
@@ -36,27 +40,53 @@ namespace SDDM {
 
         Display *displayPtr() const;
 
+        bool isStarted() const;
+        qint64 pid() const;
+
+        const QString &display() const;
+        const QString &authPath() const;
+
         void setDisplay(const QString &display);
         void setAuthPath(const QString &authPath);
 
     public slots:
         bool start();
+        bool adopt(qint64 pid);
+        qint64 detach();
+        bool reset(const QString &cookie);
         void stop();
         void finished();
 
+    private slots:
+        void checkConnection();
+        void readDisplayFd();
+        void processError(QProcess::ProcessError error);
+
     signals:
+        void started();
         void stopped();
 
     private:
-        bool waitForStarted(int msecs = 10000);
+        void waitForConnection();
+        void connected();
 
         bool m_started { false };
+        bool m_stopping { false };
+        bool m_waitForDisplayFd { false };
+        bool m_resetting { false };
+        bool m_restarting { false };
+
+        int m_attempts { 0 };
 
         QString m_display { "" };
         QString m_authPath { "" };
+        QString m_oldCookie { "" };
 
         Display *m_displayPtr { nullptr };
-        QProcess *process { nullptr };
+        ChildProcess *process { nullptr };
+        AdoptedProcess *m_adopted { nullptr };
+        DisplayServerBackend *m_backend { nullptr };
+        QTimer *m_timer { nullptr };
     };
 }
 
@@ -19,12 +19,18 @@
 
 #include "Greeter.h"
 
+#include "ChildProcess.h"
 #include "Configuration.h"
 #include "Constants.h"
 #include "DaemonApp.h"
+#include "GreeterZygote.h"
 
 #include <QDebug>
-#include <QProcess>
+#include <QTimer>
+
+#include <signal.h>
+
+#define STOP_TIMEOUT 5000
 
 namespace SDDM {
     Greeter::Greeter(QObject *parent) : QObject(parent) {
@@ -46,24 +52,66 @@ namespace SDDM {
         m_socket = socket;
     }
 
+    void Greeter::setToken(const QString &token) {
+        m_token = token;
+    }
+
     void Greeter::setTheme(const QString &theme) {
         m_theme = theme;
     }
 
+    qint64 Greeter::pid() const {
+        return m_pid;
+    }
+
+    void Greeter::setPid(qint64 pid) {
+        m_pid = pid;
+
+        // log message
+        qDebug() << " DAEMON: Greeter started.";
+
+        // emit signal
+        emit started();
+    }
+
     bool Greeter::start() {
         // check flag
         if (m_started)
             return false;
 
+        // fork greeter from the zygote
+        if (daemonApp->greeterZygote() != nullptr) {
+            // log message
+            qDebug() << " DAEMON: Greeter starting from zygote...";
+
+            // send request, the pid is set when the child is running
+            daemonApp->greeterZygote()->spawn(this, m_display, m_authPath, { "--socket", m_socket, "--token", m_token, "--theme", m_theme });
+
+            // set flag
+            m_started = true;
+
+            // return success
+            return true;
+        }
+
         // create process
-        m_process = new QProcess(this);
+        m_process = new ChildProcess(this);
 
         // delete process on finish
-        connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(finished()));
+        connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(finished(int,QProcess::ExitStatus)));
+
+        // set pid once the process is running
+        connect(m_process, SIGNAL(started()), this, SLOT(processStarted()));
+
+        // handle processes that could not be started
+        connect(m_process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(processError(QProcess::ProcessError)));
 
         // log message
         qDebug() << " DAEMON: Greeter starting...";
 
+        // set flag
+        m_started = true;
+
         // set process environment
         QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
         env.insert("DISPLAY", m_display);
@@ -71,23 +119,15 @@ namespace SDDM {
         env.insert("XCURSOR_THEME", daemonApp->configuration()->cursorTheme());
         m_process->setProcessEnvironment(env);
 
-        // start greeter
-        m_process->start(QString("%1/sddm-greeter").arg(BIN_INSTALL_DIR), { "--socket", m_socket, "--theme", m_theme });
-
-        // wait for greeter to start
-        if (!m_process->waitForStarted()) {
-            // log message
-            qCritical() << " DAEMON: Failed to start greeter.";
+        // set log sink
+        m_process->setLog(ChildProcess::logSink(daemonApp->configuration()->greeterLog()), "sddm-greeter",
+                          QString("%1/greeter%2.log").arg(LOG_DIR).arg(m_display));
 
-            // return fail
-            return false;
-        }
-
-        // log message
-        qDebug() << " DAEMON: Greeter started.";
+        // set scheduling, io and oom policy
+        m_process->setPolicy(daemonApp->configuration()->greeterPolicy());
 
-        // set flag
-        m_started = true;
+        // start greeter, failures are reported through finished
+        m_process->start(QString("%1/sddm-greeter").arg(BIN_INSTALL_DIR), { "--socket", m_socket, "--token", m_token, "--theme", m_theme });
 
         // return success
         return true;
@@ -101,15 +141,61 @@ namespace SDDM {
         // log message
         qDebug() << " DAEMON: Greeter stopping...";
 
-        // terminate process
+        // greeters forked by the zygote are not our children
+        if (m_process == nullptr) {
+            // terminate process
+            if (m_pid > 0)
+                kill(m_pid, SIGTERM);
+
+            // forget about it
+            daemonApp->greeterZygote()->cancel(this);
+
+            // reset flag
+            m_started = false;
+            m_pid = 0;
+
+            // log message
+            qDebug() << " DAEMON: Greeter stopped.";
+
+            // return
+            return;
+        }
+
+        // detach process, it deletes itself once it finished
+        m_process->disconnect(this);
+        connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)), m_process, SLOT(deleteLater()));
+
+        // terminate process, kill it if it does not finish in time
         m_process->terminate();
+        QTimer::singleShot(STOP_TIMEOUT, m_process, SLOT(kill()));
 
-        // wait for finished
-        if (!m_process->waitForFinished(5000))
-            m_process->kill();
+        // reset flag
+        m_started = false;
+        m_process = nullptr;
+        m_pid = 0;
+
+        // log message
+        qDebug() << " DAEMON: Greeter stopped.";
+    }
+
+    void Greeter::processStarted() {
+        // set pid
+        setPid(m_process->pid());
+    }
+
+    void Greeter::processError(QProcess::ProcessError error) {
+        // only handle processes that never ran, finished covers the rest
+        if (error != QProcess::FailedToStart)
+            return;
+
+        // log message
+        qCritical() << " DAEMON: Failed to start greeter.";
+
+        // report it like a crash
+        finished(EXIT_FAILURE, QProcess::CrashExit);
     }
 
-    void Greeter::finished() {
+    void Greeter::finished(int exitCode, QProcess::ExitStatus exitStatus) {
         // check flag
         if (!m_started)
             return;
@@ -121,7 +207,14 @@ namespace SDDM {
         qDebug() << " DAEMON: Greeter stopped.";
 
         // clean up
-        m_process->deleteLater();
-        m_process = nullptr;
+        if (m_process != nullptr) {
+            m_process->deleteLater();
+            m_process = nullptr;
+        }
+        m_pid = 0;
+
+        // emit signal if the greeter did not exit cleanly
+        if (exitStatus != QProcess::NormalExit || exitCode != EXIT_SUCCESS)
+            emit failed();
     }
 }
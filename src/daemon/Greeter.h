@@ -21,10 +21,11 @@
 #define SDDM_GREETER_H
 
 #include <QObject>
-
-class QProcess;
+#include <QProcess>
 
 namespace SDDM {
+    class ChildProcess;
+
     class Greeter : public QObject {
         Q_OBJECT
         Q_DISABLE_COPY(Greeter)
@@ -35,12 +36,24 @@ namespace SDDM {
         void setDisplay(const QString &display);
         void setAuthPath(const QString &authPath);
         void setSocket(const QString &socket);
+        void setToken(const QString &token);
         void setTheme(const QString &theme);
 
+        qint64 pid() const;
+        void setPid(qint64 pid);
+
     public slots:
         bool start();
         void stop();
-        void finished();
+        void finished(int exitCode, QProcess::ExitStatus exitStatus);
+
+    private slots:
+        void processStarted();
+        void processError(QProcess::ProcessError error);
+
+    signals:
+        void started();
+        void failed();
 
     private:
         bool m_started { false };
@@ -48,9 +61,12 @@ namespace SDDM {
         QString m_display { "" };
         QString m_authPath { "" };
         QString m_socket { "" };
+        QString m_token { "" };
         QString m_theme { "" };
 
-        QProcess *m_process { nullptr };
+        qint64 m_pid { 0 };
+
+        ChildProcess *m_process { nullptr };
     };
 }
 
@@ -0,0 +1,156 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+
+#include "GreeterZygote.h"
+
+#include "ChildProcess.h"
+#include "Configuration.h"
+#include "Constants.h"
+#include "DaemonApp.h"
+#include "Greeter.h"
+
+#include <QDebug>
+
+#include <signal.h>
+
+namespace SDDM {
+    GreeterZygote::GreeterZygote(QObject *parent) : QObject(parent) {
+    }
+
+    void GreeterZygote::start() {
+        // check process
+        if (m_process)
+            return;
+
+        // log message
+        qDebug() << " DAEMON: Greeter zygote starting...";
+
+        // create process
+        m_process = new ChildProcess(this);
+
+        // connect signals
+        connect(m_process, SIGNAL(readyReadStandardOutput()), this, SLOT(readyRead()));
+        connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(finished()));
+
+        // stdout carries the protocol, the greeters it forks inherit stderr
+        m_process->setLog(ChildProcess::logSink(daemonApp->configuration()->greeterLog()), "sddm-greeter",
+                          QString("%1/greeter.log").arg(LOG_DIR), false);
+
+        // the greeters it forks inherit the policy
+        m_process->setPolicy(daemonApp->configuration()->greeterPolicy());
+
+        // start zygote, requests are buffered until it runs
+        m_process->start(QString("%1/sddm-greeter").arg(BIN_INSTALL_DIR), { "--zygote", "--theme", daemonApp->configuration()->currentThemePath() });
+    }
+
+    void GreeterZygote::spawn(Greeter *greeter, const QString &display, const QString &authPath, const QStringList &arguments) {
+        // start zygote if needed
+        start();
+
+        // remember request
+        int id = ++m_lastId;
+        m_requests.insert(id, greeter);
+
+        // spawn <id> <display> <auth path> <cursor theme> <arguments>...
+        QStringList fields { "spawn", QString::number(id), display, authPath, daemonApp->configuration()->cursorTheme() };
+        fields << arguments;
+
+        // send request
+        m_process->write(fields.join("\t").toLocal8Bit() + '\n');
+    }
+
+    void GreeterZygote::cancel(Greeter *greeter) {
+        // forget pending requests, late children are killed when they are reported
+        for (int id: m_requests.keys(greeter))
+            m_requests.remove(id);
+
+        // forget running children
+        for (qint64 pid: m_greeters.keys(greeter))
+            m_greeters.remove(pid);
+    }
+
+    void GreeterZygote::readyRead() {
+        // read output
+        m_buffer.append(m_process->readAllStandardOutput());
+
+        // handle complete lines
+        int index;
+        while ((index = m_buffer.indexOf('\n')) != -1) {
+            QList<QByteArray> fields = m_buffer.left(index).split('\t');
+            m_buffer.remove(0, index + 1);
+
+            if (fields.first() == "started" && fields.size() == 3) {
+                Greeter *greeter = m_requests.take(fields.at(1).toInt());
+                qint64 pid = fields.at(2).toLongLong();
+
+                // kill children nobody waits for anymore
+                if (greeter == nullptr) {
+                    kill(pid, SIGTERM);
+                    continue;
+                }
+
+                // remember child
+                m_greeters.insert(pid, greeter);
+
+                // notify greeter
+                greeter->setPid(pid);
+            } else if (fields.first() == "failed" && fields.size() == 2) {
+                Greeter *greeter = m_requests.take(fields.at(1).toInt());
+
+                // notify greeter
+                if (greeter != nullptr)
+                    greeter->finished(EXIT_FAILURE, QProcess::CrashExit);
+            } else if (fields.first() == "finished" && fields.size() == 4) {
+                Greeter *greeter = m_greeters.take(fields.at(1).toLongLong());
+
+                // notify greeter
+                if (greeter != nullptr)
+                    greeter->finished(fields.at(2).toInt(), fields.at(3).toInt() ? QProcess::CrashExit : QProcess::NormalExit);
+            } else {
+                // log message
+                qWarning() << " DAEMON: Unknown message from greeter zygote:" << fields.first();
+            }
+        }
+    }
+
+    void GreeterZygote::finished() {
+        // log message
+        qWarning() << " DAEMON: Greeter zygote stopped.";
+
+        // orphaned greeters can not be tracked anymore
+        for (qint64 pid: m_greeters.keys())
+            kill(pid, SIGTERM);
+
+        // collect greeters
+        QList<Greeter *> greeters = m_requests.values() + m_greeters.values();
+
+        // clean up
+        m_requests.clear();
+        m_greeters.clear();
+        m_buffer.clear();
+
+        m_process->deleteLater();
+        m_process = nullptr;
+
+        // notify greeters, the zygote is started again on the next request
+        for (Greeter *greeter: greeters)
+            greeter->finished(EXIT_FAILURE, QProcess::CrashExit);
+    }
+}
@@ -0,0 +1,59 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+
+#ifndef SDDM_GREETERZYGOTE_H
+#define SDDM_GREETERZYGOTE_H
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+
+namespace SDDM {
+    class ChildProcess;
+    class Greeter;
+
+    class GreeterZygote : public QObject {
+        Q_OBJECT
+        Q_DISABLE_COPY(GreeterZygote)
+    public:
+        explicit GreeterZygote(QObject *parent = 0);
+
+        void spawn(Greeter *greeter, const QString &display, const QString &authPath, const QStringList &arguments);
+        void cancel(Greeter *greeter);
+
+    private slots:
+        void readyRead();
+        void finished();
+
+    private:
+        void start();
+
+        int m_lastId { 0 };
+
+        QByteArray m_buffer;
+
+        QHash<int, Greeter *> m_requests;
+        QHash<qint64, Greeter *> m_greeters;
+
+        ChildProcess *m_process { nullptr };
+    };
+}
+
+#endif // SDDM_GREETERZYGOTE_H
@@ -19,259 +19,429 @@
 
 #include "PowerManager.h"
 
+#include "ChildProcess.h"
 #include "Configuration.h"
 #include "DaemonApp.h"
 #include "Messages.h"
 
-#include <QDBusConnectionInterface>
-#include <QDBusInterface>
-#include <QDBusReply>
-#include <QProcess>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusServiceWatcher>
+#include <QDebug>
+#include <QHash>
+#include <QLocalSocket>
+#include <QPointer>
 
 namespace SDDM {
     /************************************************/
     /* POWER MANAGER BACKEND                        */
     /************************************************/
-    class PowerManagerBackend {
+    class PowerManagerBackend : public QObject {
+        Q_OBJECT
     public:
-        PowerManagerBackend() {
+        PowerManagerBackend(const QString &service, QObject *parent = 0) : QObject(parent), m_service(service) {
+            // refresh when the service comes and goes
+            QDBusServiceWatcher *watcher = new QDBusServiceWatcher(service, QDBusConnection::systemBus(), QDBusServiceWatcher::WatchForOwnerChange, this);
+            connect(watcher, SIGNAL(serviceOwnerChanged(QString,QString,QString)), this, SLOT(refresh()));
         }
 
         virtual ~PowerManagerBackend() {
         }
 
-        virtual Capabilities capabilities() const = 0;
+        Capabilities capabilities() const {
+            return m_capabilities;
+        }
 
-        virtual void powerOff() const = 0;
-        virtual void reboot() const = 0;
-        virtual void suspend() const = 0;
-        virtual void hibernate() const = 0;
-        virtual void hybridSleep() const = 0;
-    };
+        virtual void execute(Capability action, QLocalSocket *socket) = 0;
 
-    /**********************************************/
-    /* UPOWER BACKEND                             */
-    /**********************************************/
+    public slots:
+        virtual void refresh() = 0;
 
-#define UPOWER_SERVICE  QLatin1String("org.freedesktop.UPower")
-#define UPOWER_PATH     QLatin1String("/org/freedesktop/UPower")
-#define UPOWER_OBJECT   QLatin1String("org.freedesktop.UPower")
+    signals:
+        void capabilitiesChanged();
+        void finished(QLocalSocket *socket, const QString &error);
 
-    class UPowerBackend : public PowerManagerBackend {
-    public:
-        UPowerBackend() {
-            m_interface = new QDBusInterface(UPOWER_SERVICE, UPOWER_PATH, UPOWER_OBJECT, QDBusConnection::systemBus());
-        }
+    protected slots:
+        void callFinished(QDBusPendingCallWatcher *watcher) {
+            QDBusPendingReply<> reply = *watcher;
 
-        ~UPowerBackend() {
-            delete m_interface;
+            // report result, inhibitor denials arrive here as errors
+            finish(watcher, reply.isError() ? reply.error().message() : QString());
         }
 
-        Capabilities capabilities() const {
-            Capabilities caps = Capability::PowerOff | Capability::Reboot;
+        void processFinished(int exitCode, QProcess::ExitStatus exitStatus) {
+            QProcess *process = qobject_cast<QProcess *>(sender());
 
-            QDBusReply<bool> reply;
+            // report result
+            if (exitStatus != QProcess::NormalExit || exitCode != EXIT_SUCCESS)
+                finish(process, QString("Command exited with code %1").arg(exitCode));
+            else
+                finish(process, QString());
+        }
 
-            // suspend
-            reply = m_interface->call("SuspendAllowed");
-            if (reply.isValid() && reply.value())
-                caps |= Capability::Suspend;
+        void processError(QProcess::ProcessError error) {
+            QProcess *process = qobject_cast<QProcess *>(sender());
 
-            // hibernate
-            reply = m_interface->call("HibernateAllowed");
-            if (reply.isValid() && reply.value())
-                caps |= Capability::Hibernate;
+            // only handle processes that never ran, finished covers the rest
+            if (error != QProcess::FailedToStart)
+                return;
 
-            // return capabilities
-            return caps;
+            // report result
+            finish(process, process->errorString());
         }
 
-        void powerOff() const {
-            QProcess::execute(daemonApp->configuration()->haltCommand());
+    protected:
+        void call(const QString &path, const QString &interface, const QString &method, const QVariantList &arguments, QLocalSocket *socket) {
+            QDBusMessage message = QDBusMessage::createMethodCall(m_service, path, interface, method);
+            message.setArguments(arguments);
+
+            // send message, the result is reported when the reply arrives
+            QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(message), this);
+            connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(callFinished(QDBusPendingCallWatcher*)));
+
+            // remember requester
+            m_requests.insert(watcher, socket);
         }
 
-        void reboot() const {
-            QProcess::execute(daemonApp->configuration()->rebootCommand());
+        void spawn(const QString &command, QLocalSocket *socket) {
+            QProcess *process = new ChildProcess(this);
+            connect(process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(processFinished(int,QProcess::ExitStatus)));
+            connect(process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(processError(QProcess::ProcessError)));
+
+            // remember requester
+            m_requests.insert(process, socket);
+
+            // start command, the result is reported when it exits
+            process->start(command);
         }
 
-        void suspend() const {
-            m_interface->call("Suspend");
+        void finish(QObject *request, const QString &error) {
+            // check request
+            if (!m_requests.contains(request))
+                return;
+
+            // get requester, it may have disconnected meanwhile
+            QPointer<QLocalSocket> socket = m_requests.take(request);
+
+            // clean up
+            request->deleteLater();
+
+            // nobody to answer
+            if (socket.isNull()) {
+                // log message
+                qDebug() << " DAEMON: Power action finished after its greeter disconnected.";
+
+                // return
+                return;
+            }
+
+            // emit signal
+            emit finished(socket.data(), error);
         }
 
-        void hibernate() const {
-            m_interface->call("Hibernate");
+        QDBusPendingCallWatcher *asyncCall(const QString &path, const QString &interface, const QString &method) {
+            QDBusMessage message = QDBusMessage::createMethodCall(m_service, path, interface, method);
+
+            // do not start services that are not running
+            message.setAutoStartService(false);
+
+            // send message
+            return new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(message), this);
         }
 
-        void hybridSleep() const {
+        void setCapabilities(Capabilities capabilities) {
+            // check if changed
+            if (m_capabilities == capabilities)
+                return;
+
+            // set capabilities
+            m_capabilities = capabilities;
+
+            // emit signal
+            emit capabilitiesChanged();
         }
 
-    private:
-        QDBusInterface *m_interface { nullptr };
+        QString m_service { "" };
+
+        Capabilities m_capabilities { Capability::None };
+
+        // requesting greeters of running actions, guarded as they may disconnect
+        QHash<QObject *, QPointer<QLocalSocket>> m_requests;
+
+        // replies of older refreshes are ignored
+        int m_generation { 0 };
+        int m_pendingReplies { 0 };
+        Capabilities m_pendingCapabilities { Capability::None };
     };
 
     /**********************************************/
-    /* LOGIN1 BACKEND                             */
+    /* UPOWER BACKEND                             */
     /**********************************************/
 
-#define LOGIN1_SERVICE  QLatin1String("org.freedesktop.login1")
-#define LOGIN1_PATH     QLatin1String("/org/freedesktop/login1")
-#define LOGIN1_OBJECT   QLatin1String("org.freedesktop.login1.Manager")
+#define UPOWER_SERVICE  QLatin1String("org.freedesktop.UPower")
+#define UPOWER_PATH     QLatin1String("/org/freedesktop/UPower")
+#define UPOWER_OBJECT   QLatin1String("org.freedesktop.UPower")
 
-    class Login1Backend : public PowerManagerBackend {
+    class UPowerBackend : public PowerManagerBackend {
+        Q_OBJECT
     public:
-        Login1Backend() {
-            m_interface = new QDBusInterface(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_OBJECT, QDBusConnection::systemBus());
+        UPowerBackend(QObject *parent = 0) : PowerManagerBackend(UPOWER_SERVICE, parent) {
+            // refresh when upower reports changes
+            QDBusConnection::systemBus().connect(UPOWER_SERVICE, UPOWER_PATH, UPOWER_OBJECT, "Changed", this, SLOT(refresh()));
+            QDBusConnection::systemBus().connect(UPOWER_SERVICE, UPOWER_PATH, "org.freedesktop.DBus.Properties", "PropertiesChanged", this, SLOT(refresh()));
+
+            // get initial capabilities
+            refresh();
         }
 
-        ~Login1Backend() {
-            delete m_interface;
+        void execute(Capability action, QLocalSocket *socket) {
+            switch (action) {
+                case Capability::PowerOff:
+                    spawn(daemonApp->configuration()->haltCommand(), socket);
+                    break;
+                case Capability::Reboot:
+                    spawn(daemonApp->configuration()->rebootCommand(), socket);
+                    break;
+                case Capability::Suspend:
+                    call(UPOWER_PATH, UPOWER_OBJECT, "Suspend", QVariantList(), socket);
+                    break;
+                case Capability::Hibernate:
+                    call(UPOWER_PATH, UPOWER_OBJECT, "Hibernate", QVariantList(), socket);
+                    break;
+                default:
+                    emit finished(socket, "Action not supported");
+            }
         }
 
-        Capabilities capabilities() const {
-            Capabilities caps = Capability::None;
+    public slots:
+        void refresh() {
+            // start a new round
+            m_generation++;
+            m_pendingReplies = 2;
+            m_pendingCapabilities = Capability::None;
 
-            QDBusReply<QString> reply;
+            // ask for every capability at once
+            request("SuspendAllowed", Capability::Suspend);
+            request("HibernateAllowed", Capability::Hibernate);
+        }
 
-            // power off
-            reply = m_interface->call("CanPowerOff");
-            if (reply.isValid() && (reply.value() == "yes"))
-                caps |= Capability::PowerOff;
+    private slots:
+        void replyFinished(QDBusPendingCallWatcher *watcher) {
+            QDBusPendingReply<bool> reply = *watcher;
 
-            // reboot
-            reply = m_interface->call("CanReboot");
-            if (reply.isValid() && (reply.value() == "yes"))
-                caps |= Capability::Reboot;
+            // delete watcher
+            watcher->deleteLater();
 
-            // suspend
-            reply = m_interface->call("CanSuspend");
-            if (reply.isValid() && (reply.value() == "yes"))
-                caps |= Capability::Suspend;
-
-            // hibernate
-            reply = m_interface->call("CanHibernate");
-            if (reply.isValid() && (reply.value() == "yes"))
-                caps |= Capability::Hibernate;
+            // ignore replies of older refreshes
+            if (watcher->property("generation").toInt() != m_generation)
+                return;
 
-            // hybrid sleep
-            reply = m_interface->call("CanHybridSleep");
-            if (reply.isValid() && (reply.value() == "yes"))
-                caps |= Capability::HybridSleep;
+            // the halt and reboot commands are usable while upower runs
+            if (reply.isValid()) {
+                m_pendingCapabilities |= Capability::PowerOff | Capability::Reboot;
+                if (reply.value())
+                    m_pendingCapabilities |= Capability(watcher->property("capability").toInt());
+            }
 
-            // return capabilities
-            return caps;
+            // update capabilities once all replies arrived
+            if (--m_pendingReplies == 0)
+                setCapabilities(m_pendingCapabilities);
         }
 
-        void powerOff() const {
-            m_interface->call("PowerOff", true);
+    private:
+        void request(const QString &method, Capability capability) {
+            QDBusPendingCallWatcher *watcher = asyncCall(UPOWER_PATH, UPOWER_OBJECT, method);
+            watcher->setProperty("generation", m_generation);
+            watcher->setProperty("capability", int(capability));
+            connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(replyFinished(QDBusPendingCallWatcher*)));
         }
+    };
+
+    /**********************************************/
+    /* LOGIN1 BACKEND                             */
+    /**********************************************/
+
+#define LOGIN1_SERVICE  QLatin1String("org.freedesktop.login1")
+#define LOGIN1_PATH     QLatin1String("/org/freedesktop/login1")
+#define LOGIN1_OBJECT   QLatin1String("org.freedesktop.login1.Manager")
 
-        void reboot() const {
-            if (!daemonApp->configuration()->testing)
-                m_interface->call("Reboot", true);
+    class Login1Backend : public PowerManagerBackend {
+        Q_OBJECT
+    public:
+        Login1Backend(QObject *parent = 0) : PowerManagerBackend(LOGIN1_SERVICE, parent) {
+            // refresh after the system slept, the answers may have changed
+            QDBusConnection::systemBus().connect(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_OBJECT, "PrepareForSleep", this, SLOT(refresh()));
+
+            // get initial capabilities
+            refresh();
         }
 
-        void suspend() const {
-            m_interface->call("Suspend", true);
+        void execute(Capability action, QLocalSocket *socket) {
+            // interactive, so logind can ask polkit for authorization
+            QVariantList arguments { true };
+
+            switch (action) {
+                case Capability::PowerOff:
+                    call(LOGIN1_PATH, LOGIN1_OBJECT, "PowerOff", arguments, socket);
+                    break;
+                case Capability::Reboot:
+                    call(LOGIN1_PATH, LOGIN1_OBJECT, "Reboot", arguments, socket);
+                    break;
+                case Capability::Suspend:
+                    call(LOGIN1_PATH, LOGIN1_OBJECT, "Suspend", arguments, socket);
+                    break;
+                case Capability::Hibernate:
+                    call(LOGIN1_PATH, LOGIN1_OBJECT, "Hibernate", arguments, socket);
+                    break;
+                case Capability::HybridSleep:
+                    call(LOGIN1_PATH, LOGIN1_OBJECT, "HybridSleep", arguments, socket);
+                    break;
+                default:
+                    emit finished(socket, "Action not supported");
+            }
         }
 
-        void hibernate() const {
-            m_interface->call("Hibernate", true);
+    public slots:
+        void refresh() {
+            // start a new round
+            m_generation++;
+            m_pendingReplies = 5;
+            m_pendingCapabilities = Capability::None;
+
+            // ask for every capability at once
+            request("CanPowerOff", Capability::PowerOff);
+            request("CanReboot", Capability::Reboot);
+            request("CanSuspend", Capability::Suspend);
+            request("CanHibernate", Capability::Hibernate);
+            request("CanHybridSleep", Capability::HybridSleep);
         }
 
-        void hybridSleep() const {
-            m_interface->call("HybridSleep", true);
+    private slots:
+        void replyFinished(QDBusPendingCallWatcher *watcher) {
+            QDBusPendingReply<QString> reply = *watcher;
+
+            // delete watcher
+            watcher->deleteLater();
+
+            // ignore replies of older refreshes
+            if (watcher->property("generation").toInt() != m_generation)
+                return;
+
+            // add capability
+            if (reply.isValid() && (reply.value() == "yes"))
+                m_pendingCapabilities |= Capability(watcher->property("capability").toInt());
+
+            // update capabilities once all replies arrived
+            if (--m_pendingReplies == 0)
+                setCapabilities(m_pendingCapabilities);
         }
 
     private:
-        QDBusInterface *m_interface { nullptr };
+        void request(const QString &method, Capability capability) {
+            QDBusPendingCallWatcher *watcher = asyncCall(LOGIN1_PATH, LOGIN1_OBJECT, method);
+            watcher->setProperty("generation", m_generation);
+            watcher->setProperty("capability", int(capability));
+            connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(replyFinished(QDBusPendingCallWatcher*)));
+        }
     };
 
     /**********************************************/
     /* POWER MANAGER                              */
     /**********************************************/
     PowerManager::PowerManager(QObject *parent) : QObject(parent) {
-        QDBusConnectionInterface *interface = QDBusConnection::systemBus().interface();
+    }
 
-        // check if login1 interface exists
-        if (interface->isServiceRegistered(LOGIN1_SERVICE))
-            m_backends << new Login1Backend();
+    void PowerManager::initialize() {
+        // backends follow their services, in order of preference
+        m_backends << new Login1Backend(this);
+        m_backends << new UPowerBackend(this);
 
-        // check if upower interface exists
-        if (interface->isServiceRegistered(UPOWER_SERVICE))
-            m_backends << new UPowerBackend();
+        for (PowerManagerBackend *backend: m_backends) {
+            // update cached capabilities
+            connect(backend, SIGNAL(capabilitiesChanged()), this, SLOT(backendChanged()));
+
+            // report results of actions
+            connect(backend, SIGNAL(finished(QLocalSocket*,QString)), this, SLOT(backendFinished(QLocalSocket*,QString)));
+        }
     }
 
     PowerManager::~PowerManager() {
-        while (!m_backends.empty())
-            delete m_backends.takeFirst();
     }
 
     Capabilities PowerManager::capabilities() const {
+        return m_capabilities;
+    }
+
+    void PowerManager::refresh() {
+        // ask every backend again
+        for (PowerManagerBackend *backend: m_backends)
+            backend->refresh();
+    }
+
+    void PowerManager::backendChanged() {
         Capabilities caps = Capability::None;
 
         for (PowerManagerBackend *backend: m_backends)
             caps |= backend->capabilities();
 
-        return caps;
-    }
-
-    void PowerManager::powerOff() const {
-        if (daemonApp->configuration()->testing)
+        // check if changed
+        if (m_capabilities == caps)
             return;
 
-        for (PowerManagerBackend *backend: m_backends) {
-            if (backend->capabilities() & Capability::PowerOff) {
-                backend->powerOff();
-                break;
-            }
-        }
-    }
+        // set capabilities
+        m_capabilities = caps;
 
-    void PowerManager::reboot() const {
-        if (daemonApp->configuration()->testing)
-            return;
+        // emit signal
+        emit capabilitiesChanged(m_capabilities);
+    }
 
-        for (PowerManagerBackend *backend: m_backends) {
-            if (backend->capabilities() & Capability::Reboot) {
-                backend->reboot();
-                break;
-            }
-        }
+    void PowerManager::backendFinished(QLocalSocket *socket, const QString &error) {
+        if (error.isEmpty())
+            emit actionSucceeded(socket);
+        else
+            emit actionFailed(socket, error);
     }
 
-    void PowerManager::suspend() const {
-        if (daemonApp->configuration()->testing)
+    void PowerManager::execute(Capability action, QLocalSocket *socket) {
+        // pretend it worked in test mode
+        if (daemonApp->configuration()->testing) {
+            emit actionSucceeded(socket);
             return;
+        }
 
+        // use the first backend that can do it
         for (PowerManagerBackend *backend: m_backends) {
-            if (backend->capabilities() & Capability::Suspend) {
-                backend->suspend();
-                break;
+            if (backend->capabilities() & action) {
+                backend->execute(action, socket);
+                return;
             }
         }
+
+        // emit signal
+        emit actionFailed(socket, "Action not supported");
     }
 
-    void PowerManager::hibernate() const {
-        if (daemonApp->configuration()->testing)
-            return;
+    void PowerManager::powerOff(QLocalSocket *socket) {
+        execute(Capability::PowerOff, socket);
+    }
 
-        for (PowerManagerBackend *backend: m_backends) {
-            if (backend->capabilities() & Capability::Hibernate) {
-                backend->hibernate();
-                break;
-            }
-        }
+    void PowerManager::reboot(QLocalSocket *socket) {
+        execute(Capability::Reboot, socket);
     }
 
-    void PowerManager::hybridSleep() const {
-        if (daemonApp->configuration()->testing)
-            return;
+    void PowerManager::suspend(QLocalSocket *socket) {
+        execute(Capability::Suspend, socket);
+    }
 
-        for (PowerManagerBackend *backend: m_backends) {
-            if (backend->capabilities() & Capability::HybridSleep) {
-                backend->hybridSleep();
-                break;
-            }
-        }
+    void PowerManager::hibernate(QLocalSocket *socket) {
+        execute(Capability::Hibernate, socket);
+    }
+
+    void PowerManager::hybridSleep(QLocalSocket *socket) {
+        execute(Capability::HybridSleep, socket);
     }
 }
+
+#include "PowerManager.moc"
@@ -24,6 +24,8 @@
 
 #include "Messages.h"
 
+class QLocalSocket;
+
 namespace SDDM {
     class PowerManagerBackend;
 
@@ -35,15 +37,33 @@ namespace SDDM {
         ~PowerManager();
 
     public slots:
+        void initialize();
+
         Capabilities capabilities() const;
 
-        void powerOff() const;
-        void reboot() const;
-        void suspend() const;
-        void hibernate() const;
-        void hybridSleep() const;
+        void refresh();
+
+        void powerOff(QLocalSocket *socket);
+        void reboot(QLocalSocket *socket);
+        void suspend(QLocalSocket *socket);
+        void hibernate(QLocalSocket *socket);
+        void hybridSleep(QLocalSocket *socket);
+
+    signals:
+        void capabilitiesChanged(Capabilities capabilities);
+
+        void actionSucceeded(QLocalSocket *socket);
+        void actionFailed(QLocalSocket *socket, const QString &error);
+
+    private slots:
+        void backendChanged();
+        void backendFinished(QLocalSocket *socket, const QString &error);
 
     private:
+        void execute(Capability action, QLocalSocket *socket);
+
+        Capabilities m_capabilities { Capability::None };
+
         QList<PowerManagerBackend *> m_backends;
     };
 }
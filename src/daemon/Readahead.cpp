@@ -0,0 +1,261 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+
+#include "Readahead.h"
+
+#include "Configuration.h"
+#include "Constants.h"
+#include "DaemonApp.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#define PROFILE_FILE        STATE_DIR "/readahead"
+#define MAX_CANDIDATES      10000
+
+namespace SDDM {
+    class ReadaheadThread : public QThread {
+    public:
+        ReadaheadThread(const QString &key, QObject *parent) : QThread(parent), m_key(key) {
+        }
+
+        // replay the profile
+        void setReplay() {
+            m_replay = true;
+        }
+
+        // files mapped by these processes are recorded
+        void setPids(const QList<qint64> &pids) {
+            m_pids = pids;
+        }
+
+        // files in these directories are recorded if they are cached
+        void setDirectories(const QStringList &directories) {
+            m_directories = directories;
+        }
+
+    protected:
+        void run() {
+            if (m_replay)
+                replay();
+            else
+                record();
+        }
+
+    private:
+        void replay() {
+            QFile file(PROFILE_FILE);
+
+            // open file
+            if (!file.open(QIODevice::ReadOnly))
+                return;
+
+            QTextStream in(&file);
+
+            // profile of another theme or version
+            if (in.readLine() != m_key) {
+                qDebug() << " DAEMON: Readahead profile is outdated.";
+                return;
+            }
+
+            // queue reads for all files, the kernel does the rest
+            int count = 0;
+            while (!in.atEnd()) {
+                QByteArray path = QFile::encodeName(in.readLine());
+
+                int fd = open(path.constData(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+                if (fd == -1)
+                    continue;
+
+                posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+                close(fd);
+
+                count++;
+            }
+
+            // log message
+            qDebug() << " DAEMON: Readahead queued" << count << "files.";
+        }
+
+        void record() {
+            QStringList files;
+            QSet<QString> seen;
+
+            // files mapped by the processes, libraries, plugins and fonts
+            for (qint64 pid: m_pids) {
+                QFile maps(QString("/proc/%1/maps").arg(pid));
+                if (!maps.open(QIODevice::ReadOnly))
+                    continue;
+
+                for (const QByteArray &line: maps.readAll().split('\n')) {
+                    int index = line.indexOf('/');
+                    if (index == -1 || line.endsWith("(deleted)"))
+                        continue;
+
+                    QString path = QFile::decodeName(line.mid(index));
+                    if (!seen.contains(path)) {
+                        seen << path;
+                        files << path;
+                    }
+                }
+            }
+
+            // files that were read, qml files, images and translations
+            int candidates = 0;
+            for (const QString &directory: m_directories) {
+                QDirIterator it(directory, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+                while (it.hasNext() && candidates < MAX_CANDIDATES) {
+                    QString path = it.next();
+                    candidates++;
+
+                    if (!seen.contains(path) && isCached(path)) {
+                        seen << path;
+                        files << path;
+                    }
+                }
+            }
+
+            // create state dir if not existing
+            QDir().mkpath(STATE_DIR);
+
+            // write profile
+            QFile file(PROFILE_FILE);
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                qWarning() << " DAEMON: Failed to write readahead profile.";
+                return;
+            }
+
+            QTextStream out(&file);
+            out << m_key << "\n";
+            for (const QString &path: files)
+                out << path << "\n";
+
+            // log message
+            qDebug() << " DAEMON: Readahead profile recorded with" << files.size() << "files.";
+        }
+
+        static bool isCached(const QString &path) {
+            int fd = open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+            if (fd == -1)
+                return false;
+
+            bool result = false;
+
+            // map the file and check if any page is in the page cache
+            off_t size = lseek(fd, 0, SEEK_END);
+            if (size > 0) {
+                void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+                if (data != MAP_FAILED) {
+                    long pageSize = sysconf(_SC_PAGESIZE);
+                    QByteArray pages((size + pageSize - 1) / pageSize, 0);
+
+                    if (mincore(data, size, reinterpret_cast<unsigned char *>(pages.data())) == 0) {
+                        for (int i = 0; i < pages.size() && !result; ++i)
+                            result = pages.at(i) & 1;
+                    }
+
+                    munmap(data, size);
+                }
+            }
+
+            close(fd);
+
+            return result;
+        }
+
+        QString m_key { "" };
+        bool m_replay { false };
+        QList<qint64> m_pids;
+        QStringList m_directories;
+    };
+
+    Readahead::Readahead(QObject *parent) : QObject(parent) {
+    }
+
+    Readahead::~Readahead() {
+        // let running threads finish, they only take a moment
+        for (QThread *thread: findChildren<QThread *>())
+            thread->wait();
+    }
+
+    QString Readahead::profileKey() const {
+        QString theme = daemonApp->configuration()->currentThemePath();
+
+        // a new theme, greeter or qt version needs a new profile
+        return QString("%1 %2 %3 %4")
+               .arg(theme)
+               .arg(QFileInfo(QString("%1/metadata.desktop").arg(theme)).lastModified().toTime_t())
+               .arg(QFileInfo(QString("%1/sddm-greeter").arg(BIN_INSTALL_DIR)).lastModified().toTime_t())
+               .arg(QT_VERSION_STR);
+    }
+
+    void Readahead::start() {
+        // check option
+        if (!daemonApp->configuration()->readahead() || daemonApp->configuration()->testing)
+            return;
+
+        // record a new profile if this one does not fit
+        QFile file(PROFILE_FILE);
+        if (file.open(QIODevice::ReadOnly)) {
+            QTextStream in(&file);
+            m_recording = (in.readLine() != profileKey());
+        } else {
+            m_recording = true;
+        }
+
+        // nothing to replay
+        if (m_recording)
+            return;
+
+        // read ahead in parallel with the display server start
+        ReadaheadThread *thread = new ReadaheadThread(profileKey(), this);
+        thread->setReplay();
+        connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+        thread->start();
+    }
+
+    void Readahead::record(const QList<qint64> &pids) {
+        // only the first greeter after an outdated profile is recorded
+        if (!m_recording || m_recorded)
+            return;
+
+        // set flag
+        m_recorded = true;
+
+        // collect in the background
+        ReadaheadThread *thread = new ReadaheadThread(profileKey(), this);
+        thread->setPids(pids);
+        thread->setDirectories({ daemonApp->configuration()->currentThemePath(), IMPORTS_INSTALL_DIR, QString("%1/flags").arg(DATA_INSTALL_DIR) });
+        connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+        thread->start(QThread::LowPriority);
+    }
+}
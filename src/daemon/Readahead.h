@@ -0,0 +1,47 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+
+#ifndef SDDM_READAHEAD_H
+#define SDDM_READAHEAD_H
+
+#include <QObject>
+#include <QList>
+
+namespace SDDM {
+    class Readahead : public QObject {
+        Q_OBJECT
+        Q_DISABLE_COPY(Readahead)
+    public:
+        explicit Readahead(QObject *parent = 0);
+        ~Readahead();
+
+    public slots:
+        void start();
+        void record(const QList<qint64> &pids);
+
+    private:
+        QString profileKey() const;
+
+        bool m_recording { false };
+        bool m_recorded { false };
+    };
+}
+
+#endif // SDDM_READAHEAD_H
@@ -22,12 +22,23 @@
 #include "Configuration.h"
 #include "DaemonApp.h"
 #include "Display.h"
+#include "DisplayManager.h"
+#include "SeatManager.h"
+#include "ServiceNotifier.h"
+#include "VirtualTerminal.h"
 
+#include <QDateTime>
 #include <QDebug>
 #include <QFile>
+#include <QTimer>
 
 #include <functional>
 
+#define RESTART_DELAY_MIN   1000
+#define RESTART_DELAY_MAX   60000
+#define STABLE_UPTIME       60000
+#define REAPER_INTERVAL     10000
+
 namespace SDDM {
     int findUnused(int minimum, std::function<bool(const int)> used) {
         // initialize with minimum
@@ -41,27 +52,172 @@ namespace SDDM {
         return number;
     }
 
-    Seat::Seat(const QString &name, QObject *parent) : QObject(parent), m_name(name) {
-        createDisplay();
+    Seat::Seat(const QString &name, bool canTTY, bool isVirtual, QObject *parent) : QObject(parent), m_name(name), m_canTTY(canTTY), m_virtual(isVirtual), m_restartTimer(new QTimer(this)), m_reaperTimer(new QTimer(this)) {
+        // restart display when the backoff delay expires
+        m_restartTimer->setSingleShot(true);
+        connect(m_restartTimer, SIGNAL(timeout()), this, SLOT(restartDisplay()));
+
+        // stop greeters nobody looks at, only terminals tell us what is visible
+        connect(m_reaperTimer, SIGNAL(timeout()), this, SLOT(reapIdleDisplays()));
+        if (m_canTTY && daemonApp->configuration()->greeterIdleTimeout() > 0)
+            m_reaperTimer->start(REAPER_INTERVAL);
+
+        // take over sessions a previous daemon left running
+        for (const QVariantMap &state: daemonApp->seatManager()->takePreservedDisplays(m_name))
+            adoptDisplay(state);
+
+        // virtual displays are created on request only
+        if (m_virtual) {
+            if (daemonApp->configuration()->virtualDisplayIdleTimeout() > 0)
+                m_reaperTimer->start(REAPER_INTERVAL);
+            return;
+        }
+
+        // show a greeter unless a user session is already on screen
+        if (m_displays.isEmpty())
+            createDisplay();
     }
 
     const QString &Seat::name() const {
         return m_name;
     }
 
+    bool Seat::canTTY() const {
+        return m_canTTY;
+    }
+
+    bool Seat::isVirtual() const {
+        return m_virtual;
+    }
+
+    bool Seat::usesDisplayId(int displayId) const {
+        return m_displayIds.contains(displayId);
+    }
+
+    const QString &Seat::failureReason() const {
+        return m_failureReason;
+    }
+
+    const QList<Display *> &Seat::displays() const {
+        return m_displays;
+    }
+
+    void Seat::dumpState() const {
+        qWarning() << " DAEMON: Seat" << m_name << "tty:" << m_canTTY << "failures:" << m_failures << "reason:" << m_failureReason;
+
+        for (Display *display: m_displays)
+            qWarning() << " DAEMON:   Display" << display->name() << "vt:" << display->terminalId()
+                       << "state:" << Display::stateName(display->state())
+                       << "server:" << display->serverPid() << "greeter:" << display->greeterPid()
+                       << "user:" << display->sessionUser() << "session:" << display->sessionPid()
+                       << "inactive:" << display->inactiveTime();
+    }
+
+    Display *Seat::findSession(const QString &user) const {
+        for (Display *display: m_displays)
+            if (display->state() == Display::SessionRunning && display->sessionUser() == user)
+                return display;
+
+        return nullptr;
+    }
+
+    QList<QVariantMap> Seat::preserveSessions() {
+        QList<QVariantMap> states;
+
+        for (Display *display: QList<Display *>(m_displays)) {
+            // only displays running a user session are preserved
+            QVariantMap state = display->detach();
+            if (state.isEmpty())
+                continue;
+
+            // remember the seat
+            state["Seat"] = m_name;
+            states << state;
+
+            // forget the display, it is stopped already
+            removeDisplay(display->displayId());
+        }
+
+        // return preserved sessions
+        return states;
+    }
+
+    bool Seat::adoptDisplay(const QVariantMap &state) {
+        int displayId = state.value("DisplayId").toInt();
+        int terminalId = state.value("TerminalId").toInt();
+
+        // create a display for the running session
+        Display *display = new Display(displayId, terminalId, this);
+
+        // adopt display server and session
+        if (!display->adopt(state)) {
+            delete display;
+            return false;
+        }
+
+        // mark display and terminal as used
+        m_displayIds << displayId;
+        m_terminalIds << terminalId;
+
+        // restart display on stop
+        connect(display, SIGNAL(stopped()), this, SLOT(displayStopped()));
+
+        // report state to the service manager
+        connect(display, SIGNAL(stateChanged()), daemonApp->serviceNotifier(), SLOT(updateStatus()));
+
+        // record running display servers and sessions
+        connect(display, SIGNAL(stateChanged()), daemonApp->seatManager(), SLOT(saveSessions()));
+
+        // add display to the list
+        m_displays << display;
+
+        // export display on the bus
+        daemonApp->displayManager()->AddDisplay(display);
+
+        // return success
+        return true;
+    }
+
     void Seat::createDisplay(int displayId, int terminalId) {
+        // check flag, virtual displays need a geometry
+        if (m_stopping || m_virtual)
+            return;
+
         if (displayId == -1) {
             // find unused display
-            displayId = findUnused(0, [&](const int number) {
-                return m_displayIds.contains(number) || QFile(QString("/tmp/.X%1-lock").arg(number)).exists();
-            });
-
-            // find unused terminal
-            terminalId = findUnused(daemonApp->configuration()->minimumVT, [&](const int number) {
-                return m_terminalIds.contains(number);
-            });
+            displayId = findUnusedDisplayId();
+
+            // find unused terminal, seats without virtual terminals get none
+            if (m_canTTY) {
+                terminalId = findUnused(daemonApp->configuration()->minimumVT, [&](const int number) {
+                    return m_terminalIds.contains(number);
+                });
+            } else {
+                terminalId = 0;
+            }
         }
 
+        // start a new display
+        addDisplay(displayId, terminalId)->start();
+    }
+
+    Display *Seat::createVirtualDisplay(const QString &geometry, int depth) {
+        // check flag
+        if (m_stopping || !m_virtual)
+            return nullptr;
+
+        // create a new display without terminal
+        Display *display = addDisplay(findUnusedDisplayId(), 0);
+        display->setVirtual(geometry, depth);
+
+        // start the display
+        display->start();
+
+        // return display
+        return display;
+    }
+
+    Display *Seat::addDisplay(int displayId, int terminalId) {
         // mark display as used
         m_displayIds << displayId;
 
@@ -77,11 +233,27 @@ namespace SDDM {
         // restart display on stop
         connect(display, SIGNAL(stopped()), this, SLOT(displayStopped()));
 
+        // report state to the service manager
+        connect(display, SIGNAL(stateChanged()), daemonApp->serviceNotifier(), SLOT(updateStatus()));
+
+        // record running display servers and sessions
+        connect(display, SIGNAL(stateChanged()), daemonApp->seatManager(), SLOT(saveSessions()));
+
         // add display to the list
         m_displays << display;
 
-        // start the display
-        display->start();
+        // export display on the bus
+        daemonApp->displayManager()->AddDisplay(display);
+
+        // return display
+        return display;
+    }
+
+    int Seat::findUnusedDisplayId() const {
+        // seats start in parallel so check them all
+        return findUnused(0, [&](const int number) {
+            return daemonApp->seatManager()->isDisplayIdUsed(number) || QFile(QString("/tmp/.X%1-lock").arg(number)).exists();
+        });
     }
 
     void Seat::removeDisplay(int displayId) {
@@ -102,27 +274,197 @@ namespace SDDM {
         // remove display from list
         m_displays.removeAll(display);
 
-        // mark display and terminal ids as unused
-        m_displayIds.removeAll(display->displayId());
-        m_terminalIds.removeAll(display->terminalId());
+        // remove display from the bus
+        daemonApp->displayManager()->RemoveDisplay(display->name());
 
-        // stop the display
-        display->blockSignals(true);
+        // report state to the service manager
+        daemonApp->serviceNotifier()->updateStatus();
+
+        // release display right away if it already stopped
+        if (display->state() == Display::Stopped) {
+            releaseDisplay(display);
+            return;
+        }
+
+        // otherwise stop it, its display and terminal stay in use until it finished tearing down
+        disconnect(display, SIGNAL(stopped()), this, SLOT(displayStopped()));
+        connect(display, SIGNAL(stopped()), this, SLOT(displayRemoved()));
         display->stop();
-        display->blockSignals(false);
+    }
+
+    void Seat::displayRemoved() {
+        Display *display = qobject_cast<Display *>(sender());
+
+        // release display
+        releaseDisplay(display);
+    }
+
+    void Seat::releaseDisplay(Display *display) {
+        // mark display and terminal ids as unused
+        m_displayIds.removeOne(display->displayId());
+        m_terminalIds.removeOne(display->terminalId());
 
         // delete display
         display->deleteLater();
     }
 
+    void Seat::stop() {
+        // check flag
+        if (m_stopping)
+            return;
+
+        // set flag
+        m_stopping = true;
+
+        // do not restart anything
+        m_restartTimer->stop();
+        m_reaperTimer->stop();
+
+        // stop all displays in parallel
+        for (Display *display: QList<Display *>(m_displays))
+            display->stop();
+
+        // emit signal if there was nothing to stop
+        if (m_displays.isEmpty())
+            emit stopped();
+    }
+
     void Seat::displayStopped() {
         Display *display = qobject_cast<Display *>(sender());
 
+        // seat is going away, just collect the display
+        if (m_stopping) {
+            // remove display
+            removeDisplay(display->displayId());
+
+            // emit signal when the last one is gone
+            if (m_displays.isEmpty())
+                emit stopped();
+
+            // return
+            return;
+        }
+
+        // get failure reason
+        QString reason = display->failureReason();
+
+        // a display that ran for a while does not count as a crash loop
+        if (reason.isEmpty() || display->uptime() >= STABLE_UPTIME)
+            m_failures = 0;
+
         // remove display
         removeDisplay(display->displayId());
 
-        // restart otherwise
+        // keep running if other displays are left, virtual displays are not restarted
+        if (!m_displays.isEmpty() || m_virtual)
+            return;
+
+        // restart immediately after a normal stop
+        if (reason.isEmpty()) {
+            createDisplay();
+            return;
+        }
+
+        // count failure
+        m_failures++;
+        m_failureReason = reason;
+
+        // give up when the display keeps failing
+        if (m_failures >= daemonApp->configuration()->displayFailureLimit()) {
+            // log message
+            qCritical() << " DAEMON: Display failed" << m_failures << "times on" << m_name << ", giving up.";
+
+            // keep the reason in the status
+            m_failureReason = QString("gave up after %1 failures: %2").arg(m_failures).arg(reason);
+            daemonApp->serviceNotifier()->updateStatus();
+
+            // nothing will come up, do not let the service manager wait for it
+            daemonApp->serviceNotifier()->ready(QString("%1: %2").arg(m_name).arg(m_failureReason));
+
+            // fall back to the text console
+            if (m_canTTY && !daemonApp->configuration()->testing)
+                VirtualTerminal::activate(1);
+
+            // return
+            return;
+        }
+
+        // report state to the service manager
+        daemonApp->serviceNotifier()->updateStatus();
+
+        // get delay
+        int delay = restartDelay(m_failures);
+
+        // log message
+        qWarning() << " DAEMON: Display failed" << m_failures << "times on" << m_name << ", restarting in" << delay << "ms.";
+
+        // restart display later
+        m_restartTimer->start(delay);
+    }
+
+    int Seat::restartDelay(int failures) {
+        // double the delay for every failure
+        return qMin(RESTART_DELAY_MIN << qBound(0, failures - 1, 6), RESTART_DELAY_MAX);
+    }
+
+    void Seat::restartDisplay() {
+        // restart display unless one has been created meanwhile
         if (m_displays.isEmpty())
             createDisplay();
     }
+
+    void Seat::reapIdleDisplays() {
+        // virtual displays are reclaimed when nobody logged in for a while
+        if (m_virtual) {
+            qint64 timeout = qint64(daemonApp->configuration()->virtualDisplayIdleTimeout()) * 1000;
+            QDateTime now = QDateTime::currentDateTime();
+
+            for (Display *display: QList<Display *>(m_displays)) {
+                if (display->state() != Display::GreeterUp || display->lastTransition().msecsTo(now) < timeout)
+                    continue;
+
+                // log message
+                qDebug() << " DAEMON: Virtual display" << display->name() << "idle for" << display->lastTransition().msecsTo(now) / 1000 << "seconds.";
+
+                // remove display
+                removeDisplay(display->displayId());
+            }
+
+            return;
+        }
+
+        // get active terminal
+        int vt = VirtualTerminal::current();
+
+        // collect greeter displays
+        QList<Display *> greeters;
+        for (Display *display: m_displays) {
+            // the visible display is active by definition
+            if (display->terminalId() == vt)
+                display->markActive();
+
+            // only displays showing a greeter can be reaped
+            if (display->state() == Display::GreeterUp)
+                greeters << display;
+        }
+
+        // stop idle greeters, but always keep one
+        qint64 timeout = qint64(daemonApp->configuration()->greeterIdleTimeout()) * 1000;
+        for (Display *display: QList<Display *>(greeters)) {
+            // keep the last greeter
+            if (greeters.count() <= 1)
+                return;
+
+            // check idle time
+            if (display->terminalId() == vt || display->inactiveTime() < timeout)
+                continue;
+
+            // log message
+            qDebug() << " DAEMON: Greeter on display" << display->name() << "idle for" << display->inactiveTime() / 1000 << "seconds.";
+
+            // remove display, this releases its display number and terminal
+            greeters.removeAll(display);
+            removeDisplay(display->displayId());
+        }
+    }
 }
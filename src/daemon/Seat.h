@@ -21,6 +21,9 @@
 #define SDDM_SEAT_H
 
 #include <QObject>
+#include <QVariantMap>
+
+class QTimer;
 
 namespace SDDM {
     class Display;
@@ -29,19 +32,59 @@ namespace SDDM {
         Q_OBJECT
         Q_DISABLE_COPY(Seat)
     public:
-        explicit Seat(const QString &name, QObject *parent = 0);
+        explicit Seat(const QString &name, bool canTTY, bool isVirtual, QObject *parent = 0);
 
         const QString &name() const;
+        bool canTTY() const;
+        bool isVirtual() const;
+
+        bool usesDisplayId(int displayId) const;
+
+        const QList<Display *> &displays() const;
+
+        Display *findSession(const QString &user) const;
+
+        const QString &failureReason() const;
+
+        void dumpState() const;
+
+        QList<QVariantMap> preserveSessions();
+
+        static int restartDelay(int failures);
 
     public slots:
         void createDisplay(int displayId = -1, int terminalId = -1);
+        Display *createVirtualDisplay(const QString &geometry, int depth);
         void removeDisplay(int displayId);
 
+        void stop();
+
+    signals:
+        void stopped();
+
     private slots:
         void displayStopped();
+        void displayRemoved();
+        void restartDisplay();
+        void reapIdleDisplays();
 
     private:
+        bool adoptDisplay(const QVariantMap &state);
+        Display *addDisplay(int displayId, int terminalId);
+        void releaseDisplay(Display *display);
+        int findUnusedDisplayId() const;
+
         QString m_name { "" };
+        QString m_failureReason { "" };
+
+        bool m_canTTY { true };
+        bool m_virtual { false };
+
+        bool m_stopping { false };
+
+        int m_failures { 0 };
+        QTimer *m_restartTimer { nullptr };
+        QTimer *m_reaperTimer { nullptr };
 
         QList<Display *> m_displays;
         QList<int> m_terminalIds;
@@ -19,24 +19,300 @@
 
 #include "SeatManager.h"
 
+#include "Configuration.h"
+#include "Constants.h"
+#include "DaemonApp.h"
+#include "Display.h"
 #include "Seat.h"
+#include "ServiceNotifier.h"
+#include "VirtualTerminal.h"
+
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+#include <QStringList>
+#include <QTimer>
+
+#define LOGIN1_SERVICE      QLatin1String("org.freedesktop.login1")
+#define LOGIN1_PATH         QLatin1String("/org/freedesktop/login1")
+#define LOGIN1_OBJECT       QLatin1String("org.freedesktop.login1.Manager")
+#define LOGIN1_SEAT_OBJECT  QLatin1String("org.freedesktop.login1.Seat")
+#define LOGIN1_SESSION_OBJECT QLatin1String("org.freedesktop.login1.Session")
+#define PROPERTIES_OBJECT   QLatin1String("org.freedesktop.DBus.Properties")
+
+#define STATE_FILE          RUNTIME_DIR "/sessions"
+
+#define VIRTUAL_SEAT        QLatin1String("seatVirtual")
 
 namespace SDDM {
+    QDBusConnection login1Bus() {
+        // tests run against a mock logind on the session bus
+        if (daemonApp->configuration()->testing)
+            return QDBusConnection::sessionBus();
+
+        return QDBusConnection::systemBus();
+    }
+
     SeatManager::SeatManager(QObject *parent) : QObject(parent) {
     }
 
-    void SeatManager::createSeat(const QString &name) {
-        // create a seat
-        Seat *seat = new Seat(name, this);
+    void SeatManager::initialize() {
+        // sessions left running by the previous daemon are adopted by their seats
+        loadPreservedDisplays();
+
+        // seat0 always exists, start it before talking to the bus
+        createSeat("seat0");
+
+        // bring back virtual displays with running sessions
+        if (m_preservedDisplays.contains(VIRTUAL_SEAT))
+            createSeat(VIRTUAL_SEAT, false);
+
+        // find the other seats once the event loop runs
+        QTimer::singleShot(0, this, SLOT(enumerateSeats()));
+    }
+
+    void SeatManager::preserveSessions() {
+        // detach running sessions from their seats
+        QList<QVariantMap> states;
+        for (Seat *seat: m_seats)
+            states << seat->preserveSessions();
+
+        // write to disk now, the daemon exits next
+        writeStateFile(states);
+
+        // keep the file, displays stopping from now on must not overwrite it
+        m_sessionsPreserved = true;
+
+        // log message
+        qDebug() << " DAEMON: Preserved" << states.size() << "user sessions.";
+    }
+
+    void SeatManager::saveSessions() {
+        // check flag
+        if (daemonApp->configuration()->testing || m_sessionsPreserved || m_savePending)
+            return;
+
+        // coalesce changes of the same event loop iteration
+        m_savePending = true;
+        QTimer::singleShot(0, this, SLOT(writeSessions()));
+    }
+
+    void SeatManager::writeSessions() {
+        // reset flag
+        m_savePending = false;
+
+        // check flag
+        if (m_sessionsPreserved)
+            return;
+
+        // record every running display server, so a crashed daemon can clean up after itself
+        QList<QVariantMap> states;
+        for (Seat *seat: m_seats) {
+            for (Display *display: seat->displays()) {
+                QVariantMap state = display->runtimeState();
+                if (state.isEmpty())
+                    continue;
+
+                // remember the seat
+                state["Seat"] = seat->name();
+                states << state;
+            }
+        }
+
+        // check if changed
+        if (states == m_savedSessions)
+            return;
+
+        // write to disk
+        writeStateFile(states);
+    }
+
+    void SeatManager::writeStateFile(const QList<QVariantMap> &states) {
+        // save states
+        m_savedSessions = states;
+
+        // no file means nothing to clean up
+        if (states.isEmpty()) {
+            QFile::remove(STATE_FILE);
+            return;
+        }
+
+        // create runtime dir if not existing
+        QDir().mkpath(RUNTIME_DIR);
+
+        // open state file
+        QSettings settings(STATE_FILE, QSettings::IniFormat);
+        settings.clear();
+
+        // one group per display
+        for (const QVariantMap &state: states) {
+            settings.beginGroup(QString("Display%1").arg(state.value("DisplayId").toInt()));
+            for (const QString &key: state.keys())
+                settings.setValue(key, state.value(key));
+            settings.endGroup();
+        }
+
+        // write to disk
+        settings.sync();
+    }
+
+    void SeatManager::loadPreservedDisplays() {
+        // check file
+        if (daemonApp->configuration()->testing || !QFile::exists(STATE_FILE))
+            return;
+
+        // sessions are only adopted when enabled
+        bool preserve = daemonApp->configuration()->preserveSessions();
+
+        // read state file
+        int count = 0;
+        QSettings settings(STATE_FILE, QSettings::IniFormat);
+        for (const QString &group: settings.childGroups()) {
+            settings.beginGroup(group);
+
+            QVariantMap state;
+            for (const QString &key: settings.childKeys())
+                state[key] = settings.value(key);
+
+            settings.endGroup();
+
+            // display servers left behind without a session to adopt are stopped
+            if (!preserve || state.value("SessionPid").toLongLong() <= 0) {
+                Display::discard(state);
+                continue;
+            }
+
+            // group by seat
+            m_preservedDisplays[state.value("Seat").toString()] << state;
+            count++;
+        }
+
+        // log message
+        qDebug() << " DAEMON: Found" << count << "preserved user sessions.";
+
+        // sessions are adopted only once
+        QFile::remove(STATE_FILE);
+    }
+
+    QList<QVariantMap> SeatManager::takePreservedDisplays(const QString &seat) {
+        return m_preservedDisplays.take(seat);
+    }
+
+    void SeatManager::discardPreservedDisplays(const QStringList &seats) {
+        // sessions of seats that are gone cannot be adopted
+        for (const QString &name: m_preservedDisplays.keys()) {
+            if (seats.contains(name))
+                continue;
+
+            for (const QVariantMap &state: m_preservedDisplays.take(name))
+                Display::discard(state);
+        }
+    }
+
+    void SeatManager::enumerateSeats() {
+        QDBusConnection bus = login1Bus();
+
+        // keep seat0 only without a bus
+        if (!bus.isConnected()) {
+            qWarning() << " DAEMON: logind is not available, using seat0 only.";
+            discardPreservedDisplays(QStringList());
+            return;
+        }
+
+        // follow seat hotplug
+        bus.connect(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_OBJECT, "SeatNew", this, SLOT(logindSeatAdded(QString,QDBusObjectPath)));
+        bus.connect(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_OBJECT, "SeatRemoved", this, SLOT(logindSeatRemoved(QString,QDBusObjectPath)));
+
+        // enumerate seats
+        QDBusMessage message = QDBusMessage::createMethodCall(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_OBJECT, "ListSeats");
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(bus.asyncCall(message), this);
+        connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(listSeatsFinished(QDBusPendingCallWatcher*)));
+    }
+
+    Seat *SeatManager::seat(const QString &name) const {
+        return m_seats.value(name, nullptr);
+    }
+
+    void SeatManager::dumpState() const {
+        qWarning() << " DAEMON: Seats:" << m_seats.size() << "pending:" << m_pendingSeats.values() << "stopping:" << m_stopping;
+
+        for (Seat *seat: m_seats)
+            seat->dumpState();
+    }
+
+    QList<Seat *> SeatManager::seats() const {
+        return m_seats.values();
+    }
+
+    bool SeatManager::isDisplayIdUsed(int displayId) const {
+        for (Seat *seat: m_seats)
+            if (seat->usesDisplayId(displayId))
+                return true;
+
+        return false;
+    }
+
+    void SeatManager::createSeat(const QString &name, bool canTTY) {
+        // check flag
+        if (m_stopping || m_seats.contains(name))
+            return;
+
+        // log message
+        qDebug() << " DAEMON: Adding seat" << name << "...";
+
+        // create a seat, the virtual seat only holds displays created on request
+        Seat *seat = new Seat(name, canTTY, name == VIRTUAL_SEAT, this);
 
         // add to the list
         m_seats.insert(name, seat);
 
         // emit signal
         emit seatCreated(name);
+
+        // record adopted sessions again
+        saveSessions();
+
+        // report state to the service manager
+        daemonApp->serviceNotifier()->updateStatus();
+    }
+
+    Display *SeatManager::createVirtualDisplay(const QString &geometry, int depth) {
+        // check flag
+        if (m_stopping)
+            return nullptr;
+
+        // create the virtual seat on first use
+        createSeat(VIRTUAL_SEAT, false);
+
+        Seat *seat = m_seats.value(VIRTUAL_SEAT, nullptr);
+        if (seat == nullptr)
+            return nullptr;
+
+        // check limit
+        if (seat->displays().size() >= daemonApp->configuration()->virtualDisplayLimit()) {
+            qWarning() << " DAEMON: Virtual display limit reached.";
+            return nullptr;
+        }
+
+        // create display
+        return seat->createVirtualDisplay(geometry, depth);
     }
 
     void SeatManager::removeSeat(const QString &name) {
+        // forget about seats that are not graphical yet
+        QString path = m_pendingSeats.key(name);
+        if (!path.isEmpty()) {
+            m_pendingSeats.remove(path);
+            login1Bus().disconnect(LOGIN1_SERVICE, path, PROPERTIES_OBJECT, "PropertiesChanged", this, SLOT(logindSeatChanged(QString,QVariantMap,QStringList)));
+        }
+
         // check if seat exists
         if (!m_seats.contains(name))
             return;
@@ -44,11 +320,15 @@ namespace SDDM {
         // remove from the list
         Seat *seat = m_seats.take(name);
 
-        // delete seat
-        seat->deleteLater();
+        // delete seat once its displays stopped
+        connect(seat, SIGNAL(stopped()), seat, SLOT(deleteLater()));
+        seat->stop();
 
         // emit signal
         emit seatRemoved(name);
+
+        // report state to the service manager
+        daemonApp->serviceNotifier()->updateStatus();
     }
 
     void SeatManager::switchToGreeter(const QString &name) {
@@ -59,4 +339,246 @@ namespace SDDM {
         // switch to greeter
         m_seats[name]->createDisplay();
     }
+
+    void SeatManager::switchToUser(const QString &name, const QString &user) {
+        // check if seat exists
+        if (!m_seats.contains(name))
+            return;
+
+        // find the running session of the user
+        Display *display = m_seats[name]->findSession(user);
+
+        // show a greeter if the user has no session on this seat
+        if (display == nullptr) {
+            switchToGreeter(name);
+            return;
+        }
+
+        // without virtual terminals there is nothing to switch to
+        if (display->terminalId() <= 0) {
+            qWarning() << " DAEMON: Seat" << name << "has no virtual terminals, cannot switch to" << user;
+            return;
+        }
+
+        // log message
+        qDebug() << " DAEMON: Switching to the session of" << user << "on vt" << display->terminalId() << "...";
+
+        // just switch in test mode
+        if (daemonApp->configuration()->testing) {
+            VirtualTerminal::activate(display->terminalId());
+            return;
+        }
+
+        // find the logind session, so it can be locked before it is shown
+        QDBusMessage message = QDBusMessage::createMethodCall(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_OBJECT, "GetSessionByPID");
+        message << quint32(display->sessionPid());
+
+        // the reply does not contain the terminal
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(login1Bus().asyncCall(message), this);
+        watcher->setProperty("vt", display->terminalId());
+        connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(sessionFound(QDBusPendingCallWatcher*)));
+    }
+
+    void SeatManager::stop() {
+        // check flag
+        if (m_stopping)
+            return;
+
+        // set flag
+        m_stopping = true;
+
+        // emit signal if there is nothing to stop
+        if (m_seats.isEmpty()) {
+            emit stopped();
+            return;
+        }
+
+        // stop all seats in parallel
+        for (Seat *seat: m_seats.values()) {
+            connect(seat, SIGNAL(stopped()), this, SLOT(seatStopped()));
+            seat->stop();
+        }
+    }
+
+    void SeatManager::seatStopped() {
+        Seat *seat = qobject_cast<Seat *>(sender());
+
+        // remove from the list
+        m_seats.remove(m_seats.key(seat));
+
+        // delete seat
+        seat->deleteLater();
+
+        // emit signal when the last one is gone
+        if (m_seats.isEmpty())
+            emit stopped();
+    }
+
+    void SeatManager::logindSeatAdded(const QString &name, const QDBusObjectPath &path) {
+        // check the new seat
+        checkSeat(name, path.path());
+    }
+
+    void SeatManager::logindSeatRemoved(const QString &name, const QDBusObjectPath &path) {
+        Q_UNUSED(path);
+
+        // log message
+        qDebug() << " DAEMON: Seat" << name << "removed by logind.";
+
+        // remove seat
+        removeSeat(name);
+    }
+
+    void SeatManager::logindSeatChanged(const QString &interface, const QVariantMap &changed, const QStringList &invalidated) {
+        Q_UNUSED(invalidated);
+
+        // check interface
+        if (interface != LOGIN1_SEAT_OBJECT || !changed.contains("CanGraphical"))
+            return;
+
+        // get seat name from the object path
+        QString path = message().path();
+        if (!m_pendingSeats.contains(path))
+            return;
+
+        // check the seat again once it has graphics
+        if (changed.value("CanGraphical").toBool())
+            checkSeat(m_pendingSeats.value(path), path);
+    }
+
+    void SeatManager::listSeatsFinished(QDBusPendingCallWatcher *watcher) {
+        QDBusPendingReply<QDBusArgument> reply = *watcher;
+
+        // delete watcher
+        watcher->deleteLater();
+
+        // keep seat0 only on error, for example without logind
+        if (reply.isError()) {
+            qWarning() << " DAEMON: Failed to list seats, using seat0 only:" << reply.error().message();
+            discardPreservedDisplays(QStringList());
+            return;
+        }
+
+        // check every seat, replies arrive in parallel
+        QStringList names;
+        const QDBusArgument &argument = reply.argumentAt<0>();
+        argument.beginArray();
+        while (!argument.atEnd()) {
+            QString name;
+            QDBusObjectPath path;
+
+            argument.beginStructure();
+            argument >> name >> path;
+            argument.endStructure();
+
+            checkSeat(name, path.path());
+            names << name;
+        }
+        argument.endArray();
+
+        // preserved sessions of the listed seats are adopted once they are graphical
+        discardPreservedDisplays(names);
+    }
+
+    void SeatManager::checkSeat(const QString &name, const QString &path) {
+        QDBusConnection bus = login1Bus();
+
+        // get seat capabilities
+        QDBusMessage message = QDBusMessage::createMethodCall(LOGIN1_SERVICE, path, PROPERTIES_OBJECT, "GetAll");
+        message << LOGIN1_SEAT_OBJECT;
+
+        // the reply does not contain the seat name
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(bus.asyncCall(message), this);
+        watcher->setProperty("seat", name);
+        watcher->setProperty("path", path);
+        connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(seatPropertiesFinished(QDBusPendingCallWatcher*)));
+    }
+
+    void SeatManager::seatPropertiesFinished(QDBusPendingCallWatcher *watcher) {
+        QDBusPendingReply<QVariantMap> reply = *watcher;
+
+        // get seat name and path
+        QString name = watcher->property("seat").toString();
+        QString path = watcher->property("path").toString();
+
+        // delete watcher
+        watcher->deleteLater();
+
+        // check reply
+        if (reply.isError()) {
+            // log message
+            qWarning() << " DAEMON: Failed to get properties of seat" << name << ":" << reply.error().message();
+
+            // return
+            return;
+        }
+
+        // get properties
+        QVariantMap properties = reply.value();
+
+        // wait for seats without graphics devices
+        if (!properties.value("CanGraphical", true).toBool()) {
+            // log message
+            qDebug() << " DAEMON: Seat" << name << "is not graphical yet.";
+
+            // get notified when it changes, only once per seat
+            if (!m_pendingSeats.contains(path)) {
+                m_pendingSeats.insert(path, name);
+                login1Bus().connect(LOGIN1_SERVICE, path, PROPERTIES_OBJECT, "PropertiesChanged", this, SLOT(logindSeatChanged(QString,QVariantMap,QStringList)));
+            }
+
+            // return
+            return;
+        }
+
+        // stop watching the seat
+        if (m_pendingSeats.remove(path))
+            login1Bus().disconnect(LOGIN1_SERVICE, path, PROPERTIES_OBJECT, "PropertiesChanged", this, SLOT(logindSeatChanged(QString,QVariantMap,QStringList)));
+
+        // create seat
+        createSeat(name, properties.value("CanTTY", name == "seat0").toBool());
+    }
+
+    void SeatManager::sessionFound(QDBusPendingCallWatcher *watcher) {
+        QDBusPendingReply<QDBusObjectPath> reply = *watcher;
+
+        // get terminal
+        int vt = watcher->property("vt").toInt();
+
+        // delete watcher
+        watcher->deleteLater();
+
+        // the session could not be found, so it cannot be locked, do not show it
+        if (reply.isError()) {
+            qWarning() << " DAEMON: Session on vt" << vt << "could not be found:" << reply.error().message();
+            return;
+        }
+
+        // lock the session, the user authenticates again in its screen locker
+        QDBusMessage message = QDBusMessage::createMethodCall(LOGIN1_SERVICE, reply.value().path(), LOGIN1_SESSION_OBJECT, "Lock");
+
+        // switch once the lock request went through
+        QDBusPendingCallWatcher *lockWatcher = new QDBusPendingCallWatcher(login1Bus().asyncCall(message), this);
+        lockWatcher->setProperty("vt", vt);
+        connect(lockWatcher, SIGNAL(finished(QDBusPendingCallWatcher*)), this, SLOT(sessionLocked(QDBusPendingCallWatcher*)));
+    }
+
+    void SeatManager::sessionLocked(QDBusPendingCallWatcher *watcher) {
+        QDBusPendingReply<> reply = *watcher;
+
+        // get terminal
+        int vt = watcher->property("vt").toInt();
+
+        // delete watcher
+        watcher->deleteLater();
+
+        // the session could not be locked, do not show it
+        if (reply.isError()) {
+            qWarning() << " DAEMON: Failed to lock the session on vt" << vt << ":" << reply.error().message();
+            return;
+        }
+
+        // switch terminal
+        VirtualTerminal::activate(vt);
+    }
 }
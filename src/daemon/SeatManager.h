@@ -21,29 +21,84 @@
 #define SDDM_SEATMANAGER_H
 
 #include <QObject>
+#include <QDBusContext>
+#include <QDBusObjectPath>
 #include <QHash>
+#include <QVariantMap>
+
+class QDBusPendingCallWatcher;
 
 namespace SDDM {
+    class Display;
     class Seat;
 
-    class SeatManager : public QObject {
+    class SeatManager : public QObject, protected QDBusContext {
         Q_OBJECT
         Q_DISABLE_COPY(SeatManager)
     public:
         explicit SeatManager(QObject *parent = 0);
 
+        void initialize();
+
+        Seat *seat(const QString &name) const;
+        QList<Seat *> seats() const;
+
+        bool isDisplayIdUsed(int displayId) const;
+
+        Display *createVirtualDisplay(const QString &geometry, int depth);
+
+        void preserveSessions();
+        QList<QVariantMap> takePreservedDisplays(const QString &seat);
+
     public slots:
-        void createSeat(const QString &name);
+        void saveSessions();
+
+        void createSeat(const QString &name, bool canTTY = true);
         void removeSeat(const QString &name);
 
         void switchToGreeter(const QString &seat);
+        void switchToUser(const QString &seat, const QString &user);
+
+        void stop();
+
+        void dumpState() const;
+
+    private slots:
+        void seatStopped();
+        void writeSessions();
+
+        void enumerateSeats();
+
+        void logindSeatAdded(const QString &name, const QDBusObjectPath &path);
+        void logindSeatRemoved(const QString &name, const QDBusObjectPath &path);
+        void logindSeatChanged(const QString &interface, const QVariantMap &changed, const QStringList &invalidated);
+
+        void listSeatsFinished(QDBusPendingCallWatcher *watcher);
+        void seatPropertiesFinished(QDBusPendingCallWatcher *watcher);
+
+        void sessionFound(QDBusPendingCallWatcher *watcher);
+        void sessionLocked(QDBusPendingCallWatcher *watcher);
 
     signals:
         void seatCreated(const QString &name);
         void seatRemoved(const QString &name);
 
+        void stopped();
+
     private:
+        void checkSeat(const QString &name, const QString &path);
+        void loadPreservedDisplays();
+        void discardPreservedDisplays(const QStringList &seats);
+        void writeStateFile(const QList<QVariantMap> &states);
+
+        bool m_stopping { false };
+        bool m_sessionsPreserved { false };
+        bool m_savePending { false };
+
         QHash<QString, Seat *> m_seats;
+        QHash<QString, QString> m_pendingSeats;
+        QHash<QString, QList<QVariantMap>> m_preservedDisplays;
+        QList<QVariantMap> m_savedSessions;
     };
 }
 
@@ -0,0 +1,248 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+
+#include "ServiceNotifier.h"
+
+#include "DaemonApp.h"
+#include "Display.h"
+#include "Seat.h"
+#include "SeatManager.h"
+
+#include <QDebug>
+#include <QMap>
+#include <QStringList>
+#include <QTimer>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define LISTEN_FDS_START 3
+
+namespace SDDM {
+    ServiceNotifier::ServiceNotifier(QObject *parent) : QObject(parent) {
+        // get notification socket, children must not see it
+        m_socket = qgetenv("NOTIFY_SOCKET");
+        unsetenv("NOTIFY_SOCKET");
+
+        // take over sockets passed by the service manager
+        int count = qgetenv("LISTEN_FDS").toInt();
+        QStringList names = QString(qgetenv("LISTEN_FDNAMES")).split(':');
+        if (qgetenv("LISTEN_PID").toLongLong() == getpid()) {
+            for (int i = 0; i < count; ++i) {
+                int fd = LISTEN_FDS_START + i;
+
+                // do not leak them to children
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+                // remember by name
+                m_fds.insert(names.value(i, "unknown"), fd);
+            }
+        }
+        unsetenv("LISTEN_PID");
+        unsetenv("LISTEN_FDS");
+        unsetenv("LISTEN_FDNAMES");
+
+        // ping the watchdog from the event loop, so a hang is noticed
+        qlonglong usec = qgetenv("WATCHDOG_USEC").toLongLong();
+        QByteArray pid = qgetenv("WATCHDOG_PID");
+        if (usec > 0 && (pid.isEmpty() || pid.toLongLong() == getpid())) {
+            m_watchdogTimer = new QTimer(this);
+            m_watchdogTimer->setInterval(qMax(1LL, usec / 2000));
+            connect(m_watchdogTimer, SIGNAL(timeout()), this, SLOT(watchdog()));
+            m_watchdogTimer->start();
+        }
+        unsetenv("WATCHDOG_USEC");
+        unsetenv("WATCHDOG_PID");
+    }
+
+    bool ServiceNotifier::isEnabled() const {
+        return !m_socket.isEmpty();
+    }
+
+    bool ServiceNotifier::isStopping() const {
+        return m_stopping;
+    }
+
+    int ServiceNotifier::takeFd(const QString &name) {
+        if (!m_fds.contains(name))
+            return -1;
+
+        return m_fds.take(name);
+    }
+
+    bool ServiceNotifier::storeFd(int fd, const QString &name) {
+        if (fd == -1)
+            return false;
+
+        // keep it in the service manager over restarts
+        return notify(QString("FDSTORE=1\nFDNAME=%1").arg(name).toLocal8Bit(), fd);
+    }
+
+    void ServiceNotifier::removeFd(const QString &name) {
+        // drop it from the service manager
+        notify(QString("FDSTOREREMOVE=1\nFDNAME=%1").arg(name).toLocal8Bit());
+    }
+
+    void ServiceNotifier::ready(const QString &status) {
+        // check flag
+        if (m_ready)
+            return;
+
+        // set flag
+        m_ready = true;
+
+        // log message
+        qDebug() << " DAEMON: Ready." << qPrintable(status);
+
+        // notify service manager, tell why if nothing is on screen
+        if (status.isEmpty())
+            notify("READY=1");
+        else
+            notify(QString("READY=1\nSTATUS=%1").arg(status).toLocal8Bit());
+    }
+
+    void ServiceNotifier::reloading() {
+        notify("RELOADING=1");
+    }
+
+    void ServiceNotifier::reloaded() {
+        // only report ready again if we were before
+        if (m_ready)
+            notify("READY=1");
+    }
+
+    void ServiceNotifier::stopping() {
+        // set flag
+        m_stopping = true;
+
+        notify("STOPPING=1");
+    }
+
+    void ServiceNotifier::updateStatus() {
+        if (!isEnabled() || m_statusPending)
+            return;
+
+        // coalesce changes of the same event loop iteration
+        m_statusPending = true;
+        QTimer::singleShot(0, this, SLOT(sendStatus()));
+    }
+
+    void ServiceNotifier::sendStatus() {
+        // reset flag
+        m_statusPending = false;
+
+        // describe every seat
+        QStringList seats;
+        for (Seat *seat: daemonApp->seatManager()->seats()) {
+            QStringList displays;
+            if (seat->isVirtual()) {
+                // there may be hundreds, count them by state
+                QMap<QString, int> states;
+                for (Display *display: seat->displays())
+                    states[Display::stateName(display->state())]++;
+
+                for (auto it = states.constBegin(); it != states.constEnd(); ++it)
+                    displays << QString("%1 %2").arg(it.value()).arg(it.key());
+            } else {
+                for (Display *display: seat->displays())
+                    displays << QString("%1 %2").arg(display->name()).arg(Display::stateName(display->state()));
+            }
+
+            if (!seat->failureReason().isEmpty())
+                displays << seat->failureReason();
+
+            seats << QString("%1: %2").arg(seat->name()).arg(displays.isEmpty() ? "idle" : displays.join(", "));
+        }
+        seats.sort();
+
+        QByteArray status = QString("STATUS=%1").arg(seats.join("; ")).toLocal8Bit();
+
+        // check if changed
+        if (status == m_status)
+            return;
+
+        m_status = status;
+
+        // notify service manager
+        notify(m_status);
+    }
+
+    void ServiceNotifier::watchdog() {
+        notify("WATCHDOG=1");
+    }
+
+    bool ServiceNotifier::notify(const QByteArray &state, int fd) {
+        if (!isEnabled())
+            return false;
+
+        // set address, a leading @ means an abstract socket
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (m_socket.size() >= int(sizeof(address.sun_path)))
+            return false;
+        memcpy(address.sun_path, m_socket.constData(), m_socket.size());
+        if (address.sun_path[0] == '@')
+            address.sun_path[0] = 0;
+
+        int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sock == -1)
+            return false;
+
+        struct iovec iov;
+        iov.iov_base = const_cast<char *>(state.constData());
+        iov.iov_len = state.size();
+
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_name = &address;
+        message.msg_namelen = offsetof(struct sockaddr_un, sun_path) + m_socket.size();
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        // attach file descriptor
+        char control[CMSG_SPACE(sizeof(int))];
+        if (fd != -1) {
+            memset(control, 0, sizeof(control));
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+
+            struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(header), &fd, sizeof(int));
+        }
+
+        bool result = sendmsg(sock, &message, MSG_NOSIGNAL) != -1;
+        if (!result)
+            qWarning() << " DAEMON: Failed to notify the service manager:" << strerror(errno);
+
+        close(sock);
+
+        return result;
+    }
+}
@@ -0,0 +1,72 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+
+#ifndef SDDM_SERVICENOTIFIER_H
+#define SDDM_SERVICENOTIFIER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+
+class QTimer;
+
+namespace SDDM {
+    class ServiceNotifier : public QObject {
+        Q_OBJECT
+        Q_DISABLE_COPY(ServiceNotifier)
+    public:
+        explicit ServiceNotifier(QObject *parent = 0);
+
+        bool isEnabled() const;
+        bool isStopping() const;
+
+        int takeFd(const QString &name);
+        bool storeFd(int fd, const QString &name);
+        void removeFd(const QString &name);
+
+    public slots:
+        void ready(const QString &status = QString());
+        void reloading();
+        void reloaded();
+        void stopping();
+
+        void updateStatus();
+
+    private slots:
+        void sendStatus();
+        void watchdog();
+
+    private:
+        bool notify(const QByteArray &state, int fd = -1);
+
+        QByteArray m_socket;
+
+        bool m_ready { false };
+        bool m_stopping { false };
+        bool m_statusPending { false };
+        QByteArray m_status;
+
+        QTimer *m_watchdogTimer { nullptr };
+
+        QHash<QString, int> m_fds;
+    };
+}
+
+#endif // SDDM_SERVICENOTIFIER_H
@@ -31,13 +31,17 @@
 #include <unistd.h>
 
 namespace SDDM {
-    Session::Session(const QString &name, Authenticator *parent) : QProcess(parent), m_authenticator(parent), m_name(name) {
+    Session::Session(const QString &name, Authenticator *parent) : ChildProcess(parent), m_authenticator(parent), m_name(name) {
     }
 
     const QString &Session::name() const {
         return m_name;
     }
 
+    const QString &Session::user() const {
+        return m_user;
+    }
+
     void Session::setUser(const QString &user) {
         m_user = user;
     }
@@ -54,9 +58,19 @@ namespace SDDM {
         m_gid = gid;
     }
 
+    void Session::setAuthPath(const QString &authPath) {
+        m_authPath = authPath;
+    }
+
     void Session::setupChildProcess() {
-        if (daemonApp->configuration()->testing)
+        // restore signal mask, the policy is applied while we are still root
+        restoreSignalMask();
+        applyPolicy();
+
+        if (daemonApp->configuration()->testing) {
+            redirectOutput();
             return;
+        }
 
         if (initgroups(qPrintable(m_user), m_gid)) {
             qCritical() << " DAEMON: Failed to initialize user groups.";
@@ -90,7 +104,10 @@ namespace SDDM {
         }
 
         // add cookie
-        m_authenticator->display()->addCookie(QString("%1/.Xauthority").arg(m_dir));
+        m_authenticator->display()->addCookie(m_authPath);
+
+        // open the session log as the user
+        redirectOutput();
 
         // change to user home dir
         if (chdir(qPrintable(m_dir))) {
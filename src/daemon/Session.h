@@ -20,23 +20,25 @@
 #ifndef SDDM_SESSION_H
 #define SDDM_SESSION_H
 
-#include <QProcess>
+#include "ChildProcess.h"
 
 namespace SDDM {
     class Authenticator;
 
-    class Session : public QProcess {
+    class Session : public ChildProcess {
         Q_OBJECT
         Q_DISABLE_COPY(Session)
     public:
         explicit Session(const QString &name, Authenticator *parent);
 
         const QString &name() const;
+        const QString &user() const;
 
         void setUser(const QString &user);
         void setDir(const QString &dir);
         void setUid(int uid);
         void setGid(int gid);
+        void setAuthPath(const QString &authPath);
 
     protected:
         void setupChildProcess();
@@ -47,6 +49,7 @@ namespace SDDM {
         QString m_name { "" };
         QString m_user { "" };
         QString m_dir { "" };
+        QString m_authPath { "" };
 
         int m_uid { 0 };
         int m_gid { 0 };
@@ -17,6 +17,7 @@
 * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 ***************************************************************************/
 
+
 #include "SignalHandler.h"
 
 #include <QDebug>
@@ -25,153 +26,77 @@
 #include <signal.h>
 #include <unistd.h>
 
-#include <sys/socket.h>
+#include <sys/signalfd.h>
 
 namespace SDDM {
-    int sighupFd[2];
-    int sigintFd[2];
-    int sigtermFd[2];
-
-    SignalHandler::SignalHandler(QObject *parent) : QObject(parent) {
-        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sighupFd))
-            qCritical() << " DAEMON: Failed to create socket pair for SIGHUP handling.";
-
-        snhup = new QSocketNotifier(sighupFd[1], QSocketNotifier::Read, this);
-        connect(snhup, SIGNAL(activated(int)), this, SLOT(handleSighup()));
-
-        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sigintFd))
-            qCritical() << " DAEMON: Failed to create socket pair for SIGINT handling.";
-
-        snint = new QSocketNotifier(sigintFd[1], QSocketNotifier::Read, this);
-        connect(snint, SIGNAL(activated(int)), this, SLOT(handleSigint()));
-
-        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sigtermFd))
-            qCritical() << " DAEMON: Failed to create socket pair for SIGTERM handling.";
-
-        snterm = new QSocketNotifier(sigtermFd[1], QSocketNotifier::Read, this);
-        connect(snterm, SIGNAL(activated(int)), this, SLOT(handleSigterm()));
+    static sigset_t handledSignals() {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGHUP);
+        sigaddset(&set, SIGINT);
+        sigaddset(&set, SIGTERM);
+        sigaddset(&set, SIGUSR1);
+        sigaddset(&set, SIGUSR2);
+        return set;
     }
 
-    void SignalHandler::initialize() {
-        struct sigaction sighup;
-        sighup.sa_handler = SignalHandler::hupSignalHandler;
-        sigemptyset(&sighup.sa_mask);
-        sighup.sa_flags = 0;
-        sighup.sa_flags |= SA_RESTART;
-
-        if (sigaction(SIGHUP, &sighup, 0) > 0) {
-            qCritical() << " DAEMON: Failed to setup SIGHUP handler.";
-            return;
-        }
-
-        struct sigaction sigint;
-        sigint.sa_handler = SignalHandler::intSignalHandler;
-        sigemptyset(&sigint.sa_mask);
-        sigint.sa_flags |= SA_RESTART;
-
-        if (sigaction(SIGINT, &sigint, 0) > 0) {
-            qCritical() << " DAEMON: Failed to set up SIGINT handler.";
-            return;
-        }
-
-        struct sigaction sigterm;
-        sigterm.sa_handler = SignalHandler::termSignalHandler;
-        sigemptyset(&sigterm.sa_mask);
-        sigterm.sa_flags |= SA_RESTART;
-
-        if (sigaction(SIGTERM, &sigterm, 0) > 0) {
-            qCritical() << " DAEMON: Failed to set up SIGTERM handler.";
-            return;
-        }
-    }
-
-    void SignalHandler::hupSignalHandler(int) {
-        char a = 1;
-        if (::write(sighupFd[0], &a, sizeof(a)) == -1) {
-            qCritical() << " DAEMON: Error writing to the SIGHUP handler";
-            return;
-        }
-    }
+    SignalHandler::SignalHandler(QObject *parent) : QObject(parent) {
+        sigset_t set = handledSignals();
 
-    void SignalHandler::intSignalHandler(int) {
-        char a = 1;
-        if (::write(sigintFd[0], &a, sizeof(a)) == -1) {
-            qCritical() << " DAEMON: Error writing to the SIGINT handler";
+        // create file descriptor, the signals were blocked in initialize
+        m_fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (m_fd == -1) {
+            qCritical() << " DAEMON: Failed to create signal file descriptor.";
             return;
         }
-    }
 
-    void SignalHandler::termSignalHandler(int) {
-        char a = 1;
-        if (::write(sigtermFd[0], &a, sizeof(a)) == -1) {
-            qCritical() << " DAEMON: Error writing to the SIGTERM handler";
-            return;
-        }
+        // read signals from the event loop
+        m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+        connect(m_notifier, SIGNAL(activated(int)), this, SLOT(handleSignals()));
     }
 
-    void SignalHandler::handleSighup() {
-        // disable notifier
-        snhup->setEnabled(false);
-
-        // read from socket
-        char a;
-        if (::read(sighupFd[1], &a, sizeof(a)) == -1) {
-            // something went wrong!
-            qCritical() << " DAEMON: Error reading from the socket";
-            return;
-        }
-
-        // log event
-        qWarning() << " DAEMON: Signal received: SIGHUP";
-
-        // emit signal
-        emit sighupReceived();
-
-        // enable notifier
-        snhup->setEnabled(true);
+    SignalHandler::~SignalHandler() {
+        if (m_fd != -1)
+            close(m_fd);
     }
 
-    void SignalHandler::handleSigint() {
-        // disable notifier
-        snint->setEnabled(false);
-
-        // read from socket
-        char a;
-        if (::read(sigintFd[1], &a, sizeof(a)) == -1) {
-            // something went wrong!
-            qCritical() << " DAEMON: Error reading from the socket";
-            return;
-        }
-
-        // log event
-        qWarning() << " DAEMON: Signal received: SIGINT";
-
-        // emit signal
-        emit sigintReceived();
+    void SignalHandler::initialize() {
+        sigset_t set = handledSignals();
 
-        // enable notifier
-        snint->setEnabled(true);
+        // block signals, they are read from the file descriptor instead. this has to
+        // happen before any thread is started, so every thread inherits the mask.
+        // children get an empty mask again in ChildProcess.
+        if (sigprocmask(SIG_BLOCK, &set, nullptr) == -1)
+            qCritical() << " DAEMON: Failed to block signals.";
     }
 
-    void SignalHandler::handleSigterm() {
-        // disable notifier
-        snterm->setEnabled(false);
-
-        // read from socket
-        char a;
-        if (::read(sigtermFd[1], &a, sizeof(a)) == -1) {
-            // something went wrong!
-            qCritical() << " DAEMON: Error reading from the socket";
-            return;
+    void SignalHandler::handleSignals() {
+        struct signalfd_siginfo info;
+
+        // read all pending signals
+        while (read(m_fd, &info, sizeof(info)) == sizeof(info)) {
+            switch (info.ssi_signo) {
+                case SIGHUP:
+                    qWarning() << " DAEMON: Signal received: SIGHUP";
+                    emit sighupReceived();
+                break;
+                case SIGINT:
+                    qWarning() << " DAEMON: Signal received: SIGINT";
+                    emit sigintReceived();
+                break;
+                case SIGTERM:
+                    qWarning() << " DAEMON: Signal received: SIGTERM";
+                    emit sigtermReceived();
+                break;
+                case SIGUSR1:
+                    qWarning() << " DAEMON: Signal received: SIGUSR1";
+                    emit sigusr1Received();
+                break;
+                case SIGUSR2:
+                    qWarning() << " DAEMON: Signal received: SIGUSR2";
+                    emit sigusr2Received();
+                break;
+            }
         }
-
-        // log event
-        qWarning() << " DAEMON: Signal received: SIGTERM";
-
-        // emit signal
-        emit sigtermReceived();
-
-        // enable notifier
-        snterm->setEnabled(true);
     }
 }
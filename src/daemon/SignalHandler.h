@@ -17,6 +17,7 @@
 * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 ***************************************************************************/
 
+
 #ifndef SDDM_SIGNALHANDLER_H
 #define SDDM_SIGNALHANDLER_H
 
@@ -30,26 +31,24 @@ namespace SDDM {
         Q_DISABLE_COPY(SignalHandler)
     public:
         SignalHandler(QObject *parent = 0);
+        ~SignalHandler();
 
         static void initialize();
-        static void hupSignalHandler(int unused);
-        static void intSignalHandler(int unused);
-        static void termSignalHandler(int unused);
 
     signals:
         void sighupReceived();
         void sigintReceived();
         void sigtermReceived();
+        void sigusr1Received();
+        void sigusr2Received();
 
     private slots:
-        void handleSighup();
-        void handleSigint();
-        void handleSigterm();
+        void handleSignals();
 
     private:
-        QSocketNotifier *snhup { nullptr };
-        QSocketNotifier *snint { nullptr };
-        QSocketNotifier *snterm { nullptr };
+        int m_fd { -1 };
+
+        QSocketNotifier *m_notifier { nullptr };
     };
 }
 #endif // SDDM_SIGNALHANDLER_H
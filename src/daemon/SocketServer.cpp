@@ -20,18 +20,45 @@
 #include "SocketServer.h"
 
 #include "DaemonApp.h"
+#include "Display.h"
 #include "Messages.h"
 #include "PowerManager.h"
+#include "ServiceNotifier.h"
 #include "SocketWriter.h"
 
 #include <QLocalServer>
 
+#include <random>
+
+#define FD_NAME "greeter"
+#define TOKEN_LENGTH 16
+
 namespace SDDM {
+    QString generateToken(int length) {
+        // create random device
+        std::random_device rd;
+        std::uniform_int_distribution<> dis(0, 255);
+
+        // generate token
+        QByteArray token(length, 0);
+        for (int i = 0; i < length; ++i)
+            token[i] = char(dis(rd));
+
+        // return result
+        return QString::fromLatin1(token.toHex());
+    }
+
     SocketServer::SocketServer(QObject *parent) : QObject(parent) {
+        // push capability changes to connected greeters
+        connect(daemonApp->powerManager(), SIGNAL(capabilitiesChanged(Capabilities)), this, SLOT(capabilitiesChanged(Capabilities)));
+
+        // report results of power actions to the requesting greeter
+        connect(daemonApp->powerManager(), SIGNAL(actionSucceeded(QLocalSocket*)), this, SLOT(powerActionSucceeded(QLocalSocket*)));
+        connect(daemonApp->powerManager(), SIGNAL(actionFailed(QLocalSocket*,QString)), this, SLOT(powerActionFailed(QLocalSocket*,QString)));
     }
 
-    void SocketServer::setSocket(const QString &socket) {
-        m_socket = socket;
+    const QString &SocketServer::socket() const {
+        return m_socket;
     }
 
     bool SocketServer::start() {
@@ -50,18 +77,38 @@ namespace SDDM {
         server->setSocketOptions(QLocalServer::UserAccessOption);
 #endif
 
-        // remove existing server
-        QLocalServer::removeServer(m_socket);
-
-        // start listening
-        if (!server->listen(m_socket)) {
+#if QT_VERSION >= 0x050A00
+        // take over the socket kept over a restart, greeters find it under the old name
+        int fd = daemonApp->serviceNotifier()->takeFd(FD_NAME);
+        if (fd != -1 && server->listen(fd)) {
             // log message
-            qCritical() << " DAEMON: Failed to start socket server.";
+            qDebug() << " DAEMON: Socket server reuses" << server->fullServerName();
 
-            // return fail
-            return false;
+            m_socket = server->fullServerName();
+        } else
+#endif
+        {
+            // one socket serves all greeters
+            m_socket = QString("sddm-%1").arg(generateToken(3));
+
+            // remove existing server
+            QLocalServer::removeServer(m_socket);
+
+            // start listening
+            if (!server->listen(m_socket)) {
+                // log message
+                qCritical() << " DAEMON: Failed to start socket server.";
+
+                // return fail
+                return false;
+            }
         }
 
+#if QT_VERSION >= 0x050A00
+        // keep the socket in the service manager over restarts
+        m_fdStored = daemonApp->serviceNotifier()->storeFd(server->socketDescriptor(), FD_NAME);
+#endif
+
         // log message
         qDebug() << " DAEMON: Socket server started.";
 
@@ -86,23 +133,70 @@ namespace SDDM {
         // log message
         qDebug() << " DAEMON: Socket server stopping...";
 
-        // delete server
-        server->deleteLater();
+        if (m_fdStored && daemonApp->serviceNotifier()->isStopping()) {
+            // the next instance gets the socket from the service manager, closing
+            // the server would remove the socket file, so leave it to the exit
+            server->disconnect(this);
+            server->setParent(nullptr);
+        } else {
+            // the socket is gone for good
+            if (m_fdStored)
+                daemonApp->serviceNotifier()->removeFd(FD_NAME);
+
+            // delete server
+            server->deleteLater();
+        }
         server = nullptr;
+        m_fdStored = false;
+
+        // forget greeters
+        m_displays.clear();
+        m_greeters.clear();
 
         // log message
         qDebug() << " DAEMON: Socket server stopped.";
     }
 
+    QString SocketServer::addDisplay(Display *display) {
+        // drop the token of the previous greeter
+        removeDisplay(display);
+
+        // the greeter identifies itself with the token on connect
+        QString token = generateToken(TOKEN_LENGTH);
+        m_displays[token] = display;
+
+        // return token
+        return token;
+    }
+
+    void SocketServer::removeDisplay(Display *display) {
+        // forget the token
+        QString token = m_displays.key(display);
+        if (!token.isEmpty())
+            m_displays.remove(token);
+
+        // messages of its greeters are dropped from now on
+        for (QLocalSocket *socket: m_greeters.keys(display))
+            m_greeters.remove(socket);
+    }
+
     void SocketServer::newConnection() {
         // get pending connection
         QLocalSocket *socket = server->nextPendingConnection();
 
         // connect signals
         connect(socket, SIGNAL(readyRead()), this, SLOT(readyRead()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(disconnected()));
         connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
     }
 
+    void SocketServer::disconnected() {
+        QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+
+        // remove from the list
+        m_greeters.remove(socket);
+    }
+
     void SocketServer::readyRead() {
         QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
 
@@ -117,12 +211,43 @@ namespace SDDM {
         quint32 message;
         input >> message;
 
+        // get the display of the greeter
+        Display *display = m_greeters.value(socket);
+
+        // only connect is accepted before the greeter identified itself
+        if (!display && GreeterMessages(message) != GreeterMessages::Connect) {
+            // log message
+            qWarning() << " DAEMON: Message from unknown greeter dropped" << message;
+
+            // drop the rest
+            socket->readAll();
+            return;
+        }
+
         switch (GreeterMessages(message)) {
             case GreeterMessages::Connect: {
                 // log message
                 qDebug() << " DAEMON: Message received from greeter: Connect";
 
-                // send capabilities
+                // read token
+                QString token;
+                input >> token;
+
+                // route the greeter to its display
+                display = m_displays.value(token);
+                if (!display) {
+                    // log message
+                    qWarning() << " DAEMON: Greeter with unknown token rejected.";
+
+                    // close connection
+                    socket->disconnectFromServer();
+                    return;
+                }
+
+                // remember greeter
+                m_greeters[socket] = display;
+
+                // send capabilities, changes are pushed later
                 SocketWriter(socket) << quint32(DaemonMessages::Capabilities) << quint32(daemonApp->powerManager()->capabilities());
 
                 // send host name
@@ -137,8 +262,8 @@ namespace SDDM {
                 QString user, password, session;
                 input >> user >> password >> session;
 
-                // emit signal
-                emit login(socket, user, password, session);
+                // pass on to the display
+                display->login(socket, user, password, session);
             }
             break;
             case GreeterMessages::PowerOff: {
@@ -146,7 +271,7 @@ namespace SDDM {
                 qDebug() << " DAEMON: Message received from greeter: PowerOff";
 
                 // power off
-                daemonApp->powerManager()->powerOff();
+                daemonApp->powerManager()->powerOff(socket);
             }
             break;
             case GreeterMessages::Reboot: {
@@ -154,7 +279,7 @@ namespace SDDM {
                 qDebug() << " DAEMON: Message received from greeter: Reboot";
 
                 // reboot
-                daemonApp->powerManager()->reboot();
+                daemonApp->powerManager()->reboot(socket);
             }
             break;
             case GreeterMessages::Suspend: {
@@ -162,7 +287,7 @@ namespace SDDM {
                 qDebug() << " DAEMON: Message received from greeter: Suspend";
 
                 // suspend
-                daemonApp->powerManager()->suspend();
+                daemonApp->powerManager()->suspend(socket);
             }
             break;
             case GreeterMessages::Hibernate: {
@@ -170,7 +295,7 @@ namespace SDDM {
                 qDebug() << " DAEMON: Message received from greeter: Hibernate";
 
                 // hibernate
-                daemonApp->powerManager()->hibernate();
+                daemonApp->powerManager()->hibernate(socket);
             }
             break;
             case GreeterMessages::HybridSleep: {
@@ -178,7 +303,18 @@ namespace SDDM {
                 qDebug() << " DAEMON: Message received from greeter: HybridSleep";
 
                 // hybrid sleep
-                daemonApp->powerManager()->hybridSleep();
+                daemonApp->powerManager()->hybridSleep(socket);
+            }
+            break;
+            case GreeterMessages::Ready: {
+                // log message
+                qDebug() << " DAEMON: Message received from greeter: Ready";
+
+                // the first greeter on screen makes the daemon ready
+                daemonApp->serviceNotifier()->ready();
+
+                // pass on to the display
+                display->greeterReady();
             }
             break;
             default: {
@@ -188,6 +324,30 @@ namespace SDDM {
         }
     }
 
+    void SocketServer::capabilitiesChanged(Capabilities capabilities) {
+        for (QLocalSocket *socket: m_greeters.keys())
+            SocketWriter(socket) << quint32(DaemonMessages::Capabilities) << quint32(capabilities);
+    }
+
+    void SocketServer::powerActionSucceeded(QLocalSocket *socket) {
+        // only answer our own greeters
+        if (!m_greeters.contains(socket))
+            return;
+
+        SocketWriter(socket) << quint32(DaemonMessages::PowerActionSucceeded);
+    }
+
+    void SocketServer::powerActionFailed(QLocalSocket *socket, const QString &error) {
+        // only answer our own greeters
+        if (!m_greeters.contains(socket))
+            return;
+
+        // log message
+        qWarning() << " DAEMON: Power action failed:" << error;
+
+        SocketWriter(socket) << quint32(DaemonMessages::PowerActionFailed) << error;
+    }
+
     void SocketServer::loginFailed(QLocalSocket *socket) {
         SocketWriter(socket) << quint32(DaemonMessages::LoginFailed);
     }
@@ -20,40 +20,54 @@
 #ifndef SDDM_SOCKETSERVER_H
 #define SDDM_SOCKETSERVER_H
 
+#include <QHash>
 #include <QObject>
 #include <QString>
 
+#include "Messages.h"
+
 class QLocalServer;
 class QLocalSocket;
 
 namespace SDDM {
+    class Display;
+
     class SocketServer : public QObject {
         Q_OBJECT
         Q_DISABLE_COPY(SocketServer)
     public:
         explicit SocketServer(QObject *parent = 0);
 
-        void setSocket(const QString &name);
+        const QString &socket() const;
 
         bool start();
         void stop();
 
+        QString addDisplay(Display *display);
+        void removeDisplay(Display *display);
+
     private slots:
         void newConnection();
         void readyRead();
+        void disconnected();
+
+        void capabilitiesChanged(Capabilities capabilities);
+        void powerActionSucceeded(QLocalSocket *socket);
+        void powerActionFailed(QLocalSocket *socket, const QString &error);
 
         void loginFailed(QLocalSocket *socket);
         void loginSucceeded(QLocalSocket *socket);
 
-    signals:
-        void login(QLocalSocket *socket, const QString &user, const QString &password, const QString &session);
-
     private:
         bool m_started { false };
+        bool m_fdStored { false };
 
         QString m_socket { "" };
 
         QLocalServer *server { nullptr };
+
+        QHash<QString, Display *> m_displays;
+        QHash<QLocalSocket *, Display *> m_greeters;
     };
 }
 
@@ -0,0 +1,74 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+#include "VirtualTerminal.h"
+
+#include <QDebug>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <linux/vt.h>
+#include <sys/ioctl.h>
+
+namespace SDDM {
+    namespace VirtualTerminal {
+        bool activate(int vt) {
+            // open console
+            int fd = open("/dev/tty0", O_RDWR | O_NOCTTY);
+
+            // check file
+            if (fd < 0) {
+                // log message
+                qCritical() << " DAEMON: Failed to open the console.";
+
+                // return fail
+                return false;
+            }
+
+            // switch terminal
+            bool result = (ioctl(fd, VT_ACTIVATE, vt) == 0);
+
+            // close console
+            close(fd);
+
+            // return result
+            return result;
+        }
+    
+        int current() {
+            // open console
+            int fd = open("/dev/tty0", O_RDONLY | O_NOCTTY);
+
+            // check file
+            if (fd < 0)
+                return -1;
+
+            // get state
+            struct vt_stat state;
+            int result = (ioctl(fd, VT_GETSTATE, &state) == 0) ? state.v_active : -1;
+
+            // close console
+            close(fd);
+
+            // return result
+            return result;
+        }
+    }
+}
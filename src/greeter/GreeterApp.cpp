@@ -27,6 +27,7 @@
 #include "ThemeMetadata.h"
 #include "UserModel.h"
 #include "KeyboardModel.h"
+#include "Zygote.h"
 
 #ifdef USE_QT5
 #include "MessageHandler.h"
@@ -42,6 +43,7 @@
 #include <QDeclarativeEngine>
 #endif
 #include <QDebug>
+#include <QTimer>
 #include <QTranslator>
 
 #include <iostream>
@@ -82,6 +84,9 @@ namespace SDDM {
         // get socket name
         QString socket = parameter(arguments(), "--socket", "");
 
+        // get display token
+        QString token = parameter(arguments(), "--token", "");
+
         // get theme path
         QString themePath = parameter(arguments(), "--theme", "");
 
@@ -127,7 +132,7 @@ namespace SDDM {
         m_sessionModel = new SessionModel();
         m_screenModel = new ScreenModel();
         m_userModel = new UserModel();
-        m_proxy = new GreeterProxy(socket);
+        m_proxy = new GreeterProxy(socket, token);
         m_keyboard = new KeyboardModel();
 
         if(!testing && !m_proxy->isConnected()) {
@@ -165,12 +170,28 @@ namespace SDDM {
         // connect screen update signals
         connect(m_screenModel, SIGNAL(primaryChanged()), this, SLOT(show()));
 
+        // tell the daemon once the first frame is on screen
+#ifdef USE_QT5
+        connect(m_view, SIGNAL(frameSwapped()), this, SLOT(frameSwapped()));
+#else
+        QTimer::singleShot(0, this, SLOT(frameSwapped()));
+#endif
+
         show();
 #ifndef USE_QT5
         m_view->show();
 #endif
     }
 
+    void GreeterApp::frameSwapped() {
+        // only the first frame counts
+#ifdef USE_QT5
+        disconnect(m_view, SIGNAL(frameSwapped()), this, SLOT(frameSwapped()));
+#endif
+
+        m_proxy->ready();
+    }
+
     void GreeterApp::show() {
         m_view->setGeometry(m_screenModel->geometry());
 #ifdef USE_QT5
@@ -195,11 +216,22 @@ int main(int argc, char **argv) {
                      "Options: \n"
                      "  --theme <theme path>       Set greeter theme\n"
                      "  --socket <socket name>     Set socket name\n"
+                     "  --token <token>            Set display token\n"
+                     "  --zygote                   Fork greeters on request from the daemon\n"
                      "  --test                     Testing mode" << std::endl;
 
         return EXIT_FAILURE;
     }
 
+    if (arguments.contains(QLatin1String("--zygote"))) {
+        // get theme path
+        QString themePath = SDDM::parameter(arguments, "--theme", "");
+
+        // wait for requests, only returns true in the forked greeters
+        if (!SDDM::Zygote::run(themePath, argc, argv))
+            return EXIT_SUCCESS;
+    }
+
     SDDM::GreeterApp app(argc, argv);
 
     return app.exec();
@@ -58,6 +58,7 @@ namespace SDDM {
 
     private slots:
         void show();
+        void frameSwapped();
 
     private:
         static GreeterApp *self;
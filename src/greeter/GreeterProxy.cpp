@@ -31,6 +31,7 @@ namespace SDDM {
     public:
         SessionModel *sessionModel { nullptr };
         QLocalSocket *socket { nullptr };
+        QString token { "" };
         QString hostName { "" };
         bool canPowerOff { false };
         bool canReboot { false };
@@ -39,8 +40,9 @@ namespace SDDM {
         bool canHybridSleep { false };
     };
 
-    GreeterProxy::GreeterProxy(const QString &socket, QObject *parent) : QObject(parent), d(new GreeterProxyPrivate()) {
+    GreeterProxy::GreeterProxy(const QString &socket, const QString &token, QObject *parent) : QObject(parent), d(new GreeterProxyPrivate()) {
         d->socket = new QLocalSocket(this);
+        d->token = token;
         // connect signals
         connect(d->socket, SIGNAL(connected()), this, SLOT(connected()));
         connect(d->socket, SIGNAL(disconnected()), this, SLOT(disconnected()));
@@ -88,6 +90,10 @@ namespace SDDM {
         return d->socket->state() == QLocalSocket::ConnectedState;
     }
 
+    void GreeterProxy::ready() {
+        SocketWriter(d->socket) << quint32(GreeterMessages::Ready);
+    }
+
     void GreeterProxy::powerOff() {
         SocketWriter(d->socket) << quint32(GreeterMessages::PowerOff);
     }
@@ -128,8 +134,8 @@ namespace SDDM {
         // log connection
         qDebug() << "GREETER: Connected to the daemon.";
 
-        // send connected message
-        SocketWriter(d->socket) << quint32(GreeterMessages::Connect);
+        // send connected message, the token tells the daemon our display
+        SocketWriter(d->socket) << quint32(GreeterMessages::Connect) << d->token;
     }
 
     void GreeterProxy::disconnected() {
@@ -201,6 +207,26 @@ namespace SDDM {
                     emit loginFailed();
                 }
                 break;
+                case DaemonMessages::PowerActionSucceeded: {
+                    // log message
+                    qDebug() << "GREETER: Message received from daemon: PowerActionSucceeded";
+
+                    // emit signal
+                    emit powerActionSucceeded();
+                }
+                break;
+                case DaemonMessages::PowerActionFailed: {
+                    // log message
+                    qDebug() << "GREETER: Message received from daemon: PowerActionFailed";
+
+                    // read error
+                    QString error;
+                    input >> error;
+
+                    // emit signal
+                    emit powerActionFailed(error);
+                }
+                break;
                 default: {
                     // log message
                     qWarning() << "GREETER: Unknown message received from daemon.";
@@ -40,7 +40,7 @@ namespace SDDM {
         Q_PROPERTY(bool     canHybridSleep  READ canHybridSleep NOTIFY canHybridSleepChanged)
 
     public:
-        explicit GreeterProxy(const QString &socket, QObject *parent = 0);
+        explicit GreeterProxy(const QString &socket, const QString &token, QObject *parent = 0);
         ~GreeterProxy();
 
         const QString &hostName() const;
@@ -55,6 +55,8 @@ namespace SDDM {
 
         void setSessionModel(SessionModel *model);
 
+        void ready();
+
     public slots:
         void powerOff();
         void reboot();
@@ -81,6 +83,9 @@ namespace SDDM {
         void loginFailed();
         void loginSucceeded();
 
+        void powerActionSucceeded();
+        void powerActionFailed(const QString &error);
+
     private:
         GreeterProxyPrivate *d { nullptr };
     };
@@ -0,0 +1,297 @@
+/***************************************************************************
+* Copyright (c) 2013 Abdurrahman AVCI <abdurrahmanavci@gmail.com>
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the
+* Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+***************************************************************************/
+
+
+#include "Zygote.h"
+
+#include "Constants.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QDirIterator>
+#include <QFile>
+#include <QLibraryInfo>
+#include <QList>
+#include <QRegExp>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+namespace SDDM {
+    namespace Zygote {
+        static QList<QByteArray> childArguments;
+        static QVector<char *> childArgv;
+
+        void preload(const QString &path) {
+            QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+
+            while (it.hasNext()) {
+                // open file
+                int fd = open(qPrintable(it.next()), O_RDONLY | O_CLOEXEC);
+
+                // check file
+                if (fd < 0)
+                    continue;
+
+                // ask the kernel to read it in the background
+                posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+
+                // close file
+                close(fd);
+            }
+        }
+
+        int loadPlugins(const QString &path) {
+            int count = 0;
+
+            for (const QString &file: QDir(path).entryList(QStringList() << "*.so", QDir::Files)) {
+                // map and relocate it now, the greeter gets the same handle when it loads the plugin
+                if (dlopen(qPrintable(QString("%1/%2").arg(path).arg(file)), RTLD_NOW) != nullptr)
+                    count++;
+            }
+
+            return count;
+        }
+
+        QSet<QString> findImports(const QString &path) {
+            QSet<QString> imports;
+            QRegExp regExp("^\\s*import\\s+([A-Za-z][\\w.]*)\\s+(\\d+)");
+
+            QDirIterator it(path, QStringList() << "*.qml", QDir::Files, QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+            while (it.hasNext()) {
+                QFile file(it.next());
+                if (!file.open(QIODevice::ReadOnly))
+                    continue;
+
+                // collect module and major version
+                for (const QByteArray &line: file.readAll().split('\n'))
+                    if (regExp.indexIn(QString::fromUtf8(line)) != -1)
+                        imports << QString("%1 %2").arg(regExp.cap(1)).arg(regExp.cap(2));
+            }
+
+            return imports;
+        }
+
+        int loadImport(const QStringList &importPaths, const QString &module, const QString &major) {
+            QString modulePath = QString(module).replace('.', '/');
+
+            // versioned directories come first
+            QStringList candidates = QStringList() << QString("%1.%2").arg(modulePath).arg(major) << modulePath;
+            if (module.contains('.'))
+                candidates.insert(1, QString("%1.%2/%3").arg(module.section('.', 0, 0)).arg(major).arg(module.section('.', 1).replace('.', '/')));
+
+            // load the plugins of the first match
+            for (const QString &importPath: importPaths) {
+                for (const QString &candidate: candidates) {
+                    QString path = QString("%1/%2").arg(importPath).arg(candidate);
+                    if (QFile::exists(QString("%1/qmldir").arg(path)))
+                        return loadPlugins(path);
+                }
+            }
+
+            return 0;
+        }
+
+        int loadImports(const QStringList &paths) {
+            // modules are looked up like the engine does, in the Qt import path and ours
+#ifdef USE_QT5
+            QStringList importPaths = QStringList() << QLibraryInfo::location(QLibraryInfo::Qml2ImportsPath) << IMPORTS_INSTALL_DIR;
+#else
+            QStringList importPaths = QStringList() << QLibraryInfo::location(QLibraryInfo::ImportsPath) << IMPORTS_INSTALL_DIR;
+#endif
+
+            QSet<QString> imports;
+            for (const QString &path: paths)
+                imports += findImports(path);
+
+            int count = 0;
+            for (const QString &import: imports)
+                count += loadImport(importPaths, import.section(' ', 0, 0), import.section(' ', 1, 1));
+
+            return count;
+        }
+
+        void reply(const QByteArray &message) {
+            QByteArray data = message + '\n';
+
+            // write the whole message
+            for (int written = 0; written < data.size();) {
+                ssize_t result = write(STDOUT_FILENO, data.constData() + written, data.size() - written);
+
+                if (result < 0)
+                    return;
+
+                written += result;
+            }
+        }
+
+        bool spawn(const QList<QByteArray> &fields, const sigset_t &mask, int sigfd, int &argc, char **&argv) {
+            // spawn <id> <display> <auth path> <cursor theme> <arguments>...
+            if (fields.size() < 5) {
+                qWarning() << "GREETER: Invalid zygote request.";
+                return false;
+            }
+
+            // fork
+            pid_t pid = fork();
+
+            if (pid < 0) {
+                reply("failed\t" + fields.at(1));
+                return false;
+            }
+
+            if (pid > 0) {
+                reply("started\t" + fields.at(1) + '\t' + QByteArray::number(pid));
+                return false;
+            }
+
+            // child: restore signal handling
+            close(sigfd);
+            sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+            // detach from the daemon pipes
+            int null = open("/dev/null", O_RDWR);
+            dup2(null, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+            close(null);
+
+            // set environment
+            setenv("DISPLAY", fields.at(2).constData(), 1);
+            setenv("XAUTHORITY", fields.at(3).constData(), 1);
+            setenv("XCURSOR_THEME", fields.at(4).constData(), 1);
+
+            // build argument list
+            childArguments << QByteArray(argv[0]);
+            for (int i = 5; i < fields.size(); ++i)
+                childArguments << fields.at(i);
+
+            for (QByteArray &argument: childArguments)
+                childArgv << argument.data();
+            childArgv << nullptr;
+
+            argc = childArguments.size();
+            argv = childArgv.data();
+
+            // return to main
+            return true;
+        }
+
+        bool run(const QString &themePath, int &argc, char **&argv) {
+            // watch child exits through a signalfd
+            sigset_t mask, oldMask;
+            sigemptyset(&mask);
+            sigaddset(&mask, SIGCHLD);
+            sigprocmask(SIG_BLOCK, &mask, &oldMask);
+
+            int sigfd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+            if (sigfd < 0) {
+                qCritical() << "GREETER: Failed to create zygote signal descriptor.";
+                return false;
+            }
+
+            // warm up the page cache for the theme and the components
+            QString componentsPath = QString("%1/SddmComponents").arg(IMPORTS_INSTALL_DIR);
+            preload(themePath);
+            preload(componentsPath);
+
+            // the Qt libraries are linked already, load the plugins the greeter
+            // needs too, so forked greeters find them mapped and relocated
+            int count = loadImports(QStringList() << themePath << componentsPath);
+            QString pluginsPath = QLibraryInfo::location(QLibraryInfo::PluginsPath);
+#ifdef USE_QT5
+            if (dlopen(qPrintable(QString("%1/platforms/libqxcb.so").arg(pluginsPath)), RTLD_NOW) != nullptr)
+                count++;
+            count += loadPlugins(QString("%1/xcbglintegrations").arg(pluginsPath));
+#endif
+            count += loadPlugins(QString("%1/imageformats").arg(pluginsPath));
+
+            // log message
+            qDebug() << "GREETER: Zygote ready," << count << "plugins loaded.";
+
+            QByteArray buffer;
+
+            while (true) {
+                struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { sigfd, POLLIN, 0 } };
+
+                if (poll(fds, 2, -1) < 0)
+                    continue;
+
+                // reap children
+                if (fds[1].revents & POLLIN) {
+                    // consume the signal, several exits may be coalesced into one
+                    struct signalfd_siginfo info;
+                    if (read(sigfd, &info, sizeof(info)) != sizeof(info))
+                        qWarning() << "GREETER: Failed to read zygote signal descriptor.";
+
+                    int status;
+                    pid_t pid;
+                    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                        bool crashed = !WIFEXITED(status);
+                        int exitCode = crashed ? WTERMSIG(status) : WEXITSTATUS(status);
+
+                        reply("finished\t" + QByteArray::number(pid) + '\t' + QByteArray::number(exitCode) + '\t' + QByteArray::number(crashed ? 1 : 0));
+                    }
+                }
+
+                // read requests
+                if (fds[0].revents & (POLLIN | POLLHUP)) {
+                    char data[4096];
+                    ssize_t count = read(STDIN_FILENO, data, sizeof(data));
+
+                    // exit when the daemon goes away
+                    if (count <= 0)
+                        break;
+
+                    buffer.append(data, count);
+
+                    // handle complete lines
+                    int index;
+                    while ((index = buffer.indexOf('\n')) != -1) {
+                        QList<QByteArray> fields = buffer.left(index).split('\t');
+                        buffer.remove(0, index + 1);
+
+                        if (fields.first() == "spawn" && spawn(fields, oldMask, sigfd, argc, argv))
+                            return true;
+                    }
+                }
+            }
+
+            // log message
+            qDebug() << "GREETER: Zygote exiting.";
+
+            // close descriptor
+            close(sigfd);
+
+            // return to main and exit
+            return false;
+        }
+    }
+}
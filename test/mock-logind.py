@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+#
+# Minimal logind for running the daemon in test mode against a private bus.
+#
+# The daemon talks to logind on the session bus when started with
+# --test-mode, so run both on a bus of their own:
+#
+#   dbus-run-session -- sh -c 'test/mock-logind.py /tmp/mock-logind & sleep 1; sddm --test-mode'
+#
+# seat0 exists from the start. Commands change the seats and emit the
+# signals the daemon follows. They are read from the FIFO given as the
+# argument, which is created if needed, or from stdin without one:
+#
+#   echo 'add seat1' > /tmp/mock-logind
+#
+#
+#   add <seat> [nographics]   emit SeatNew, without graphics CanGraphical is false
+#   graphical <seat>          set CanGraphical and emit PropertiesChanged
+#   remove <seat>             emit SeatRemoved
+#   list                      print the known seats
+#
+# GetSessionByPID fails with NoSessionForPID, so nothing is locked.
+#
+# Requires python3-dbus and python3-gi.
+
+import os
+import sys
+
+import dbus
+import dbus.mainloop.glib
+import dbus.service
+from gi.repository import GLib
+
+SERVICE = 'org.freedesktop.login1'
+PATH = '/org/freedesktop/login1'
+MANAGER = 'org.freedesktop.login1.Manager'
+SEAT = 'org.freedesktop.login1.Seat'
+PROPERTIES = 'org.freedesktop.DBus.Properties'
+
+
+class Seat(dbus.service.Object):
+    def __init__(self, bus, name, graphical):
+        self.name = name
+        self.path = '%s/seat/%s' % (PATH, name)
+        self.graphical = graphical
+        dbus.service.Object.__init__(self, bus, self.path)
+
+    def properties(self):
+        return {
+            'Id': dbus.String(self.name),
+            'CanTTY': dbus.Boolean(self.name == 'seat0'),
+            'CanGraphical': dbus.Boolean(self.graphical),
+        }
+
+    @dbus.service.method(PROPERTIES, in_signature='s', out_signature='a{sv}')
+    def GetAll(self, interface):
+        return self.properties() if interface == SEAT else {}
+
+    @dbus.service.method(PROPERTIES, in_signature='ss', out_signature='v')
+    def Get(self, interface, name):
+        return self.properties()[name]
+
+    @dbus.service.signal(PROPERTIES, signature='sa{sv}as')
+    def PropertiesChanged(self, interface, changed, invalidated):
+        pass
+
+
+class Manager(dbus.service.Object):
+    def __init__(self, bus):
+        self.bus = bus
+        self.seats = {}
+        dbus.service.Object.__init__(self, bus, PATH)
+        self.add('seat0', True)
+
+    def add(self, name, graphical):
+        if name in self.seats:
+            return
+        seat = Seat(self.bus, name, graphical)
+        self.seats[name] = seat
+        self.SeatNew(name, dbus.ObjectPath(seat.path))
+
+    def remove(self, name):
+        seat = self.seats.pop(name, None)
+        if seat is None:
+            return
+        seat.remove_from_connection()
+        self.SeatRemoved(name, dbus.ObjectPath(seat.path))
+
+    def set_graphical(self, name):
+        seat = self.seats.get(name)
+        if seat is None:
+            return
+        seat.graphical = True
+        seat.PropertiesChanged(SEAT, {'CanGraphical': dbus.Boolean(True)}, [])
+
+    @dbus.service.method(MANAGER, in_signature='', out_signature='a(so)')
+    def ListSeats(self):
+        return [(name, dbus.ObjectPath(seat.path)) for name, seat in self.seats.items()]
+
+    @dbus.service.method(MANAGER, in_signature='u', out_signature='o')
+    def GetSessionByPID(self, pid):
+        raise dbus.exceptions.DBusException('No session for PID %d' % pid,
+                                            name='org.freedesktop.login1.NoSessionForPID')
+
+    @dbus.service.signal(MANAGER, signature='so')
+    def SeatNew(self, name, path):
+        print('SeatNew %s' % name, flush=True)
+
+    @dbus.service.signal(MANAGER, signature='so')
+    def SeatRemoved(self, name, path):
+        print('SeatRemoved %s' % name, flush=True)
+
+
+def command(manager, line):
+    words = line.split()
+    if len(words) >= 2 and words[0] == 'add':
+        manager.add(words[1], 'nographics' not in words[2:])
+    elif len(words) == 2 and words[0] == 'graphical':
+        manager.set_graphical(words[1])
+    elif len(words) == 2 and words[0] == 'remove':
+        manager.remove(words[1])
+    elif words == ['list']:
+        print(' '.join(sorted(manager.seats)), flush=True)
+    elif words:
+        print('Unknown command: %s' % line.strip(), file=sys.stderr, flush=True)
+
+
+def reader(manager, fd):
+    buffer = b''
+
+    def read(source, condition):
+        nonlocal buffer
+        try:
+            data = os.read(fd, 4096)
+        except BlockingIOError:
+            return True
+        if not data:
+            return False
+
+        buffer += data
+        while b'\n' in buffer:
+            line, buffer = buffer.split(b'\n', 1)
+            command(manager, line.decode())
+
+        return True
+
+    return read
+
+
+def main():
+    dbus.mainloop.glib.DBusGMainLoop(set_as_default=True)
+
+    bus = dbus.SessionBus()
+    name = dbus.service.BusName(SERVICE, bus, do_not_queue=True)
+    manager = Manager(bus)
+
+    if len(sys.argv) > 1:
+        # keep a writer open ourselves, so the FIFO never reports end of file
+        if not os.path.exists(sys.argv[1]):
+            os.mkfifo(sys.argv[1])
+        fd = os.open(sys.argv[1], os.O_RDWR | os.O_NONBLOCK)
+    else:
+        fd = sys.stdin.fileno()
+
+    GLib.io_add_watch(fd, GLib.IO_IN | GLib.IO_HUP, reader(manager, fd))
+    GLib.MainLoop().run()
+
+
+if __name__ == '__main__':
+    main()